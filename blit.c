@@ -0,0 +1,351 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Copy strategies for scanout buffers. Dumb buffers are often mapped write-combined or uncached,
+ * and whether plain memcpy, non-temporal stores, rep movsb or several threads fill them fastest
+ * depends on the driver and the SoC, so it is measured on the real mapping.
+ *
+ * The cache file has one line per device:
+ *   <device> <driver> <major>.<minor>.<patch> <width>x<height>/<pitch> <strategy> <GB/s>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "drm_framebuffer.h"
+#include "kernels.h"
+#include "blit.h"
+
+/* Smaller copies don't pay for waking up the threads */
+#define BLIT_THREADS_MIN_BYTES (1 << 20)
+#define BLIT_THREADS_MAX 4
+/* Best of this many runs per strategy */
+#define BLIT_TUNE_RUNS 3
+
+static void blit_memcpy(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+			uint32_t row_bytes, uint32_t rows)
+{
+	for (uint32_t y = 0; y < rows; y++)
+		memcpy(&dst[(size_t)y * dst_pitch], &src[(size_t)y * src_pitch], row_bytes);
+}
+
+static void blit_kernel(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+			uint32_t row_bytes, uint32_t rows)
+{
+	for (uint32_t y = 0; y < rows; y++)
+		kernels.copy(&dst[(size_t)y * dst_pitch], &src[(size_t)y * src_pitch], row_bytes);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Non-temporal stores write whole lines without reading them first and bypass the cache */
+static __attribute__((target("sse2"))) void
+blit_stream(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+	    uint32_t row_bytes, uint32_t rows)
+{
+	for (uint32_t y = 0; y < rows; y++) {
+		uint8_t *d = &dst[(size_t)y * dst_pitch];
+		const uint8_t *s = &src[(size_t)y * src_pitch];
+		size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+		size_t i;
+
+		if (head > row_bytes)
+			head = row_bytes;
+		memcpy(d, s, head);
+		for (i = head; i + 16 <= row_bytes; i += 16)
+			_mm_stream_si128((__m128i *)&d[i],
+					 _mm_loadu_si128((const __m128i *)&s[i]));
+		memcpy(&d[i], &s[i], row_bytes - i);
+	}
+	_mm_sfence();
+}
+
+static void blit_movsb(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+		       uint32_t row_bytes, uint32_t rows)
+{
+	for (uint32_t y = 0; y < rows; y++) {
+		uint8_t *d = &dst[(size_t)y * dst_pitch];
+		const uint8_t *s = &src[(size_t)y * src_pitch];
+		size_t n = row_bytes;
+
+		__asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+	}
+}
+
+static int stream_supported(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static int movsb_supported(void)
+{
+	return 1;
+}
+#endif
+
+struct blit_part {
+	pthread_t thread;
+	uint8_t *dst;
+	uint32_t dst_pitch;
+	const uint8_t *src;
+	uint32_t src_pitch;
+	uint32_t row_bytes;
+	uint32_t rows;
+};
+
+static void *blit_part(void *arg)
+{
+	struct blit_part *part = arg;
+
+	blit_memcpy(part->dst, part->dst_pitch, part->src, part->src_pitch, part->row_bytes,
+		    part->rows);
+
+	return NULL;
+}
+
+static int blit_thread_count;
+
+/* Bands of rows on several threads, the calling one copies the last band */
+static void blit_threads(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+			 uint32_t row_bytes, uint32_t rows)
+{
+	struct blit_part parts[BLIT_THREADS_MAX];
+	int count = blit_thread_count;
+	int started[BLIT_THREADS_MAX];
+	uint32_t first = 0;
+
+	if ((uint64_t)row_bytes * rows < BLIT_THREADS_MIN_BYTES || count < 2 ||
+	    rows < (uint32_t)count) {
+		blit_memcpy(dst, dst_pitch, src, src_pitch, row_bytes, rows);
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		uint32_t band = rows / count + ((uint32_t)i < rows % count);
+
+		parts[i] = (struct blit_part){
+			.dst = &dst[(size_t)first * dst_pitch],
+			.dst_pitch = dst_pitch,
+			.src = &src[(size_t)first * src_pitch],
+			.src_pitch = src_pitch,
+			.row_bytes = row_bytes,
+			.rows = band,
+		};
+		first += band;
+	}
+
+	for (int i = 0; i < count - 1; i++) {
+		started[i] = !pthread_create(&parts[i].thread, NULL, blit_part, &parts[i]);
+		if (!started[i])
+			blit_part(&parts[i]);
+	}
+	blit_part(&parts[count - 1]);
+	for (int i = 0; i < count - 1; i++) {
+		if (started[i])
+			pthread_join(parts[i].thread, NULL);
+	}
+}
+
+static int threads_supported(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	blit_thread_count = cpus > BLIT_THREADS_MAX ? BLIT_THREADS_MAX : cpus;
+
+	return blit_thread_count > 1;
+}
+
+static int always_supported(void)
+{
+	return 1;
+}
+
+static const struct {
+	const char *name;
+	blit_fn fn;
+	int (*supported)(void);
+} strategies[] = {
+	{ "memcpy", blit_memcpy, always_supported },
+	{ "kernel", blit_kernel, always_supported },
+#if defined(__x86_64__) || defined(__i386__)
+	{ "stream", blit_stream, stream_supported },
+	{ "movsb", blit_movsb, movsb_supported },
+#endif
+	{ "threads", blit_threads, threads_supported },
+};
+
+blit_fn blit = blit_memcpy;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Everything which may change the result of the measurement */
+static void cache_key(struct framebuffer *fb, const char *device, char *key, size_t size)
+{
+	drmVersionPtr version = drmGetVersion(fb->fd);
+
+	snprintf(key, size, "%s %s %d.%d.%d %ux%u/%u", device, version ? version->name : "unknown",
+		 version ? version->version_major : 0, version ? version->version_minor : 0,
+		 version ? version->version_patchlevel : 0, fb->virt_x, fb->virt_y,
+		 fb->dumb_framebuffer.pitch);
+	if (version)
+		drmFreeVersion(version);
+}
+
+static int cache_lookup(const char *cache_path, const char *key, double *rate)
+{
+	char line[512];
+	size_t len = strlen(key);
+	FILE *file;
+	int found = -1;
+
+	file = fopen(cache_path, "r");
+	if (!file)
+		return -1;
+
+	while (found < 0 && fgets(line, sizeof(line), file)) {
+		char name[32];
+
+		if (strncmp(line, key, len) || line[len] != ' ')
+			continue;
+		if (sscanf(&line[len + 1], "%31s %lf", name, rate) != 2)
+			continue;
+		for (size_t i = 0; i < ARRAY_SIZE(strategies); i++) {
+			if (strcmp(strategies[i].name, name) == 0 && strategies[i].supported())
+				found = i;
+		}
+	}
+	fclose(file);
+
+	return found;
+}
+
+/* Replaces the line of this device, the others are kept */
+static void cache_store(const char *cache_path, const char *key, int strategy, double rate)
+{
+	char tmp[4096], line[512];
+	size_t len = strlen(key);
+	FILE *in, *out;
+	int ok;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", cache_path);
+	out = fopen(tmp, "w");
+	if (!out) {
+		print_verbose("Could not write blit cache %s\n", tmp);
+		return;
+	}
+
+	in = fopen(cache_path, "r");
+	while (in && fgets(line, sizeof(line), in)) {
+		if (strncmp(line, key, len) || line[len] != ' ')
+			fputs(line, out);
+	}
+	if (in)
+		fclose(in);
+
+	fprintf(out, "%s %s %.2f\n", key, strategies[strategy].name, rate);
+	ok = !ferror(out);
+	if (fclose(out) || !ok || rename(tmp, cache_path)) {
+		print_verbose("Could not write blit cache %s\n", cache_path);
+		remove(tmp);
+	}
+}
+
+int blit_tune(struct framebuffer *fb, const char *device, const char *cache_path)
+{
+	uint32_t row_bytes = fb->virt_x * 4, pitch = fb->dumb_framebuffer.pitch;
+	size_t size = (size_t)row_bytes * fb->virt_y;
+	double best_rate = 0, rate;
+	int best = -1;
+	char key[512];
+	uint8_t *src;
+
+	cache_key(fb, device, key, sizeof(key));
+	if (cache_path) {
+		best = cache_lookup(cache_path, key, &best_rate);
+		if (best >= 0) {
+			blit = strategies[best].fn;
+			print_verbose("Blit strategy %s from cache, %.2f GB/s\n",
+				      strategies[best].name, best_rate);
+			return 0;
+		}
+	}
+
+	src = malloc(size);
+	if (!src)
+		return -ENOMEM;
+	for (size_t i = 0; i < size; i++)
+		src[i] = i * 31;
+
+	for (size_t i = 0; i < ARRAY_SIZE(strategies); i++) {
+		double fastest = 0;
+
+		if (!strategies[i].supported())
+			continue;
+
+		for (int run = 0; run < BLIT_TUNE_RUNS; run++) {
+			double start = now(), time;
+
+			strategies[i].fn(fb->data, pitch, src, row_bytes, row_bytes, fb->virt_y);
+			time = now() - start;
+			if (!fastest || time < fastest)
+				fastest = time;
+		}
+
+		/* The buffer may be too small for the clock to see the copy */
+		if (fastest <= 0)
+			continue;
+		rate = size / fastest / 1e9;
+		print_verbose("Blit %s: %.2f GB/s\n", strategies[i].name, rate);
+		if (rate > best_rate) {
+			best_rate = rate;
+			best = i;
+		}
+	}
+
+	free(src);
+	memset(fb->data, 0, fb->size);
+
+	/* Nothing measured a rate, memcpy is fine and nothing is cached */
+	if (best < 0) {
+		blit = blit_memcpy;
+		print_verbose("Blit rates could not be measured, using memcpy\n");
+		return 0;
+	}
+
+	blit = strategies[best].fn;
+	print_verbose("Blit strategy %s, %.2f GB/s\n", strategies[best].name, best_rate);
+
+	if (cache_path)
+		cache_store(cache_path, key, best, best_rate);
+
+	return 0;
+}
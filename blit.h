@@ -0,0 +1,37 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <stdint.h>
+
+#include "drm_framebuffer.h"
+
+/* Copies rows of row_bytes between two pitched buffers, usually into a mapped scanout buffer */
+typedef void (*blit_fn)(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+			uint32_t row_bytes, uint32_t rows);
+
+/* The strategy chosen by blit_tune(), plain memcpy per row until then */
+extern blit_fn blit;
+
+/*
+ * Times every copy strategy on the mapped buffer of fb and uses the fastest. The result is kept
+ * in cache_path per device, driver and buffer size, so later starts skip the measurement. Leaves
+ * fb->data black.
+ */
+int blit_tune(struct framebuffer *fb, const char *device, const char *cache_path);
+
+#endif
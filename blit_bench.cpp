@@ -0,0 +1,147 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Times the blits of libdrmfb.hpp into a mapped scanout buffer against a plain memcpy per row. A
+ * copy between equal formats should run at memcpy speed, the other combinations show what the
+ * conversion or the blend costs on top. The results are printed as JSON like the ones of color.
+ *
+ *	blit_bench [-t <seconds per blit>] [-d <device>] [-c <connector>]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include "libdrmfb.hpp"
+
+using namespace libdrmfb;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Runs blit over and over for duration seconds, returns the bytes written per second */
+template <class Blit> static double measure(const view<xrgb8888> &dst, double duration, Blit blit)
+{
+	auto start = std::chrono::steady_clock::now();
+	uint64_t frames = 0;
+	double elapsed;
+
+	do {
+		blit();
+		frames++;
+		elapsed = seconds_since(start);
+	} while (elapsed < duration);
+
+	return frames * (double)dst.width * dst.height * xrgb8888::bytes / elapsed;
+}
+
+static void print_result(const char *name, double rate, double memcpy_rate, bool last)
+{
+	std::printf("\t\t{ \"blit\": \"%s\", \"gbps\": %.3f, \"of_memcpy\": %.3f }%s\n", name,
+		    rate / 1e9, rate / memcpy_rate, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+	const char *device = "/dev/dri/card0";
+	const char *connector = "HDMI-A-1";
+	double duration = 1.0;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:d:c:h")) != -1) {
+		switch (c) {
+		case 't':
+			duration = std::strtod(optarg, nullptr);
+			break;
+		case 'd':
+			device = optarg;
+			break;
+		case 'c':
+			connector = optarg;
+			break;
+		default:
+			std::fprintf(stderr, "usage: %s [-t <seconds>] [-d <device>] [-c <connector>]\n",
+				     argv[0]);
+			return 1;
+		}
+	}
+	if (duration <= 0) {
+		std::fprintf(stderr, "invalid duration\n");
+		return 1;
+	}
+
+	try {
+		display display(device, connector);
+		view<xrgb8888> dst = display.acquire();
+		uint32_t w = dst.width, h = dst.height;
+		std::vector<uint32_t> pixels((size_t)w * h);
+		std::vector<uint16_t> pixels565((size_t)w * h);
+		std::vector<uint32_t> surface((size_t)w * h);
+		uint32_t seed = 1;
+
+		/* Some opaque, some transparent and some translucent premultiplied pixels */
+		for (size_t i = 0; i < pixels.size(); i++) {
+			uint32_t alpha = i % 3 == 0 ? 0xff : i % 3 == 1 ? 0 : 0x80;
+
+			seed = seed * 1103515245 + 12345;
+			pixels[i] = seed | 0xff000000;
+			pixels565[i] = seed >> 16;
+			surface[i] = alpha << 24 | ((seed & 0xfefefe) >> 1 & (alpha ? 0x7f7f7f : 0));
+		}
+
+		view<xrgb8888> src(pixels.data(), w, h, w * 4);
+		view<rgb565> src565(pixels565.data(), w, h, w * 2);
+		view<argb8888> src_surface(surface.data(), w, h, w * 4);
+
+		double memcpy_rate = measure(dst, duration, [&] {
+			for (uint32_t y = 0; y < h; y++)
+				std::memcpy(dst.row(y), src.row(y), (size_t)w * 4);
+		});
+		double copy_rate = measure(dst, duration, [&] {
+			blit<xrgb8888, xrgb8888, copy>(src, dst);
+		});
+		double convert_rate = measure(dst, duration, [&] {
+			blit<rgb565, xrgb8888, copy>(src565, dst);
+		});
+		double blend_rate = measure(dst, duration, [&] {
+			blit<argb8888, xrgb8888, blend>(src_surface, dst);
+		});
+
+		display.present();
+
+		std::printf("{\n\t\"device\": \"%s\",\n\t\"connector\": \"%s\",\n"
+			    "\t\"width\": %u, \"height\": %u,\n\t\"duration\": %.3f,\n"
+			    "\t\"results\": [\n",
+			    device, connector, w, h, duration);
+		print_result("memcpy", memcpy_rate, memcpy_rate, false);
+		print_result("xrgb8888 copy xrgb8888", copy_rate, memcpy_rate, false);
+		print_result("rgb565 copy xrgb8888", convert_rate, memcpy_rate, false);
+		print_result("argb8888 blend xrgb8888", blend_rate, memcpy_rate, true);
+		std::printf("\t]\n}\n");
+	} catch (const std::system_error &e) {
+		std::fprintf(stderr, "%s on %s: %s\n", connector, device, e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+
+int create_dumb_buffer(int fd, uint32_t width, uint32_t height, uint32_t format,
+		       struct dumb_buffer *buf)
+{
+	struct drm_mode_create_dumb creq;
+	struct drm_mode_map_dumb mreq;
+	uint32_t handles[4] = { 0 };
+	uint32_t pitches[4] = { 0 };
+	uint32_t offsets[4] = { 0 };
+	int err;
+
+	memset(buf, 0, sizeof(*buf));
+
+	memset(&creq, 0, sizeof(creq));
+	creq.width = width;
+	creq.height = height;
+	creq.bpp = format == DRM_FORMAT_RGB565 ? 16 : 32;
+
+	err = drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq);
+	if (err) {
+		err = -errno;
+		print_error("Could not create dumb buffer %ux%u (err=%d)\n", width, height, err);
+		return err;
+	}
+
+	buf->width = width;
+	buf->height = height;
+	buf->pitch = creq.pitch;
+	buf->handle = creq.handle;
+	buf->size = creq.size;
+
+	handles[0] = buf->handle;
+	pitches[0] = buf->pitch;
+	err = drmModeAddFB2(fd, width, height, format, handles, pitches, offsets, &buf->fb_id, 0);
+	if (err) {
+		print_error("Could not add framebuffer to drm (err=%d)\n", err);
+		goto error;
+	}
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.handle = buf->handle;
+
+	err = drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq);
+	if (err) {
+		err = -errno;
+		print_error("Mode map dumb buffer failed (err=%d)\n", err);
+		goto error;
+	}
+
+	buf->data = mmap(0, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mreq.offset);
+	if (buf->data == MAP_FAILED) {
+		buf->data = 0;
+		err = -errno;
+		print_error("Mode map failed (err=%d)\n", err);
+		goto error;
+	}
+
+	memset(buf->data, 0, buf->size);
+
+	return 0;
+
+error:
+	destroy_dumb_buffer(fd, buf);
+	return err;
+}
+
+void destroy_dumb_buffer(int fd, struct dumb_buffer *buf)
+{
+	struct drm_mode_destroy_dumb dreq;
+
+	if (buf->data)
+		munmap(buf->data, buf->size);
+	if (buf->fb_id)
+		drmModeRmFB(fd, buf->fb_id);
+	if (buf->handle) {
+		memset(&dreq, 0, sizeof(dreq));
+		dreq.handle = buf->handle;
+		drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	}
+
+	memset(buf, 0, sizeof(*buf));
+}
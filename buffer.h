@@ -0,0 +1,37 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdint.h>
+
+/* A mapped dumb buffer with a framebuffer object attached to it */
+struct dumb_buffer {
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+	uint32_t handle;
+	uint32_t fb_id;
+	uint64_t size;
+	uint8_t *data;
+};
+
+int create_dumb_buffer(int fd, uint32_t width, uint32_t height, uint32_t format,
+		       struct dumb_buffer *buf);
+void destroy_dumb_buffer(int fd, struct dumb_buffer *buf);
+
+#endif
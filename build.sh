@@ -2,13 +2,49 @@
 
 set -e
 
+# The same binary picks SSE2/AVX2/AVX-512 or NEON kernels at runtime, no -m flags needed
 #CC=aarch64-linux-gnu-gcc
 CC=gcc
+LD=${CC%gcc}ld
+OBJCOPY=${CC%gcc}objcopy
+CXX=${CC%gcc}g++
 CFLAGS="-O0 -ggdb -pedantic -Wall -I /usr/include/libdrm -I."
-LDFLAGS="-ldrm"
+LDFLAGS="-ldrm -lpthread -lm"
+# The templated blits are only worth timing when they are optimized, -O3 vectorizes the conversions
+CXXFLAGS="-std=c++17 -O3 -Wall -Wextra -I /usr/include/libdrm -I."
+
+# libdrmfb, for programs which render into the scanout buffers themselves
+LIB_OBJS="framebuffer.o resources.o topology.o lease.o buffer.o fcache.o kernels.o kernels_x86.o kernels_neon.o blit.o pattern.o libdrmfb.o"
+OBJS="drm_framebuffer.o planes.o compose.o cursor.o stream.o client.o font.o console.o loop.o qoi.o pipeline.o image.o slideshow.o watch.o config.o hotplug.o still.o vblank.o"
 
 $CC $CFLAGS -c -o picture.o picture.s
-$CC $CFLAGS -c -o drm_framebuffer.o drm_framebuffer.c
-$CC $CFLAGS -z noexecstack -o drm_framebuffer drm_framebuffer.o picture.o $LDFLAGS
+for obj in $LIB_OBJS $OBJS; do
+	$CC $CFLAGS -fPIC -fvisibility=hidden -c -o $obj ${obj%.o}.c
+done
+# Only drmfb_* and pattern_* are exported. The static library is a single object with the
+# hidden symbols made local, so names like verbose or blit can't clash with the program's own.
+$LD -r -o libdrmfb_all.o $LIB_OBJS
+$OBJCOPY --localize-hidden libdrmfb_all.o
+rm -f libdrmfb.a
+ar rcs libdrmfb.a libdrmfb_all.o
+$CC $CFLAGS -shared -o libdrmfb.so $LIB_OBJS $LDFLAGS
+# The tools use the internals, so they link the objects instead of the library
+$CC $CFLAGS -z noexecstack -o drm_framebuffer $OBJS picture.o $LIB_OBJS $LDFLAGS
+$CC $CFLAGS -o color color.c $LIB_OBJS $LDFLAGS
+# Uses libdrmfb.hpp like an embedding program would
+$CXX $CXXFLAGS -o blit_bench blit_bench.cpp libdrmfb.a $LDFLAGS
+
+# Every SIMD kernel has to give the same pixels as the scalar one, a mismatch fails the build
+case ${CC%gcc} in
+"")
+	./drm_framebuffer -K check
+	;;
+aarch64*)
+	QEMU_LD_PREFIX=${QEMU_LD_PREFIX:-/usr/aarch64-linux-gnu} qemu-aarch64 ./drm_framebuffer -K check
+	;;
+*)
+	echo "No way to run the kernel check for $CC, skipped"
+	;;
+esac
 
 # cat 1.png | convert -extent 1920x1080 -gravity Center - bgra:- | cat >1.dat
@@ -0,0 +1,145 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Thin client of the stream daemon: copies commands and pixel data from stdin to the daemon's
+ * socket and prints the replies which are not "ok". It never touches the DRM device, so starting
+ * it is cheap and the daemon keeps the display state between clients.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "client.h"
+
+/* Prints the complete reply lines in buf, returns the number of errors among them */
+static int handle_replies(char *buf, size_t *len)
+{
+	char *line = buf;
+	char *end;
+	int errors = 0;
+
+	while ((end = memchr(line, '\n', *len - (line - buf)))) {
+		*end = '\0';
+		if (strcmp(line, "ok") != 0) {
+			printf("%s\n", line);
+			errors++;
+		}
+		line = end + 1;
+	}
+	*len -= line - buf;
+	memmove(buf, line, *len);
+
+	return errors;
+}
+
+int run_client(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	struct pollfd fds[2];
+	char input[65536];
+	char replies[256];
+	size_t input_len = 0;
+	size_t input_off = 0;
+	size_t replies_len = 0;
+	int input_open = 1;
+	int errors = 0;
+	int sock;
+	int err = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("Could not connect to the daemon on %s\n", socket_path);
+		err = -errno;
+		goto cleanup;
+	}
+
+	/*
+	 * Replies are read while the input is still being sent, otherwise a long command stream
+	 * fills both socket buffers and the client and the daemon wait for each other.
+	 */
+	fds[0].fd = sock;
+	fds[1].fd = STDIN_FILENO;
+	for (;;) {
+		ssize_t n;
+
+		fds[0].events = POLLIN | (input_off < input_len ? POLLOUT : 0);
+		fds[1].events = input_open && input_off == input_len ? POLLIN : 0;
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		if (fds[1].revents) {
+			n = read(STDIN_FILENO, input, sizeof(input));
+			if (n <= 0) {
+				input_open = 0;
+				shutdown(sock, SHUT_WR);
+			} else {
+				input_len = n;
+				input_off = 0;
+			}
+		}
+
+		if (fds[0].revents & POLLOUT) {
+			n = send(sock, input + input_off, input_len - input_off, MSG_NOSIGNAL);
+			if (n < 0) {
+				printf("Connection to the daemon lost\n");
+				err = -errno;
+				break;
+			}
+			input_off += n;
+		}
+
+		if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			n = recv(sock, replies + replies_len, sizeof(replies) - 1 - replies_len, 0);
+			if (n <= 0)
+				break;
+			replies_len += n;
+			errors += handle_replies(replies, &replies_len);
+			/* A reply longer than the buffer is no reply of the daemon */
+			if (replies_len == sizeof(replies) - 1) {
+				err = -EPROTO;
+				break;
+			}
+		}
+	}
+
+	if (!err && input_open) {
+		printf("The daemon closed the connection early\n");
+		err = -EPIPE;
+	}
+
+cleanup:
+	close(sock);
+
+	if (err)
+		return err;
+	return errors ? -EINVAL : 0;
+}
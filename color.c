@@ -31,6 +31,8 @@
 #define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -42,6 +44,9 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include "kernels.h"
+#include "pattern.h"
+
 struct modeset_dev;
 static int modeset_find_crtc(int fd, drmModeRes *res, drmModeConnector *conn,
 			     struct modeset_dev *dev);
@@ -50,8 +55,13 @@ static int modeset_setup_dev(int fd, drmModeRes *res, drmModeConnector *conn,
 			     struct modeset_dev *dev);
 static int modeset_open(int *out, const char *node);
 static int modeset_prepare(int fd);
-static void modeset_draw(void);
 static void modeset_cleanup(int fd);
+static void bench_fill(struct modeset_dev *dev);
+static void bench_setcrtc(int fd, struct modeset_dev *dev);
+static void bench_flip(int fd, struct modeset_dev *dev);
+
+/* seconds each measurement runs, set with -t */
+static double bench_duration = 1.0;
 
 /*
  * When the linux kernel detects a graphics-card on your machine, it loads the
@@ -506,11 +516,13 @@ err_destroy:
  * prepares all connectors and we can loop over "modeset_list" and call
  * drmModeSetCrtc() on every CRTC/connector combination.
  *
- * But printing empty black pages is boring so we have another helper function
- * modeset_draw() that draws some colors into the framebuffer for 5 seconds and
- * then returns. And then we have all the cleanup functions which correctly free
- * all devices again after we used them. All these functions are described below
- * the main() function.
+ * But printing empty black pages is boring, so this example has become a
+ * benchmark. bench_fill() fills the framebuffer of the first connector with
+ * every fill method on 1, 2, 4, ... threads, bench_setcrtc() and bench_flip()
+ * time drmModeSetCrtc() and page flips on every connector. The results are
+ * printed as JSON. And then we have all the cleanup functions which correctly
+ * free all devices again after we used them. All these functions are
+ * described below the main() function.
  *
  * As a side note: drmModeSetCrtc() actually takes a list of connectors that we
  * want to control with this CRTC. We pass only one connector, though. As
@@ -529,18 +541,37 @@ err_destroy:
 
 int main(int argc, char **argv)
 {
-	int ret, fd;
+	int ret, fd, c;
 	const char *card;
 	struct modeset_dev *iter;
 
+	while ((c = getopt(argc, argv, "t:h")) != -1) {
+		switch (c) {
+		case 't':
+			bench_duration = strtod(optarg, NULL);
+			if (bench_duration <= 0) {
+				fprintf(stderr, "invalid duration %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t <seconds per measurement>] [device]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
 	/* check which DRM device to open */
-	if (argc > 1)
-		card = argv[1];
+	if (optind < argc)
+		card = argv[optind];
 	else
 		card = "/dev/dri/card0";
 
 	fprintf(stderr, "using card '%s'\n", card);
 
+	/* pick the SIMD fill and copy for this CPU */
+	kernels_init(NULL);
+
 	/* open the DRM device */
 	ret = modeset_open(&fd, card);
 	if (ret)
@@ -560,8 +591,29 @@ int main(int argc, char **argv)
 				errno);
 	}
 
-	/* draw some colors for 5seconds */
-	modeset_draw();
+	/* run the measurements, the fill rate only on the first connector */
+	printf("{\n\t\"device\": \"%s\",\n\t\"duration\": %.3f,\n", card, bench_duration);
+	if (modeset_list) {
+		printf("\t\"fill\": {\n\t\t\"connector\": %u, \"width\": %u, \"height\": %u,\n"
+		       "\t\t\"results\": [",
+		       modeset_list->conn, modeset_list->width, modeset_list->height);
+		bench_fill(modeset_list);
+		printf("\n\t\t]\n\t},\n");
+	} else {
+		printf("\t\"fill\": null,\n");
+	}
+	printf("\t\"connectors\": [");
+	for (iter = modeset_list; iter; iter = iter->next) {
+		printf("%s\n\t\t{ \"connector\": %u, \"crtc\": %u, \"mode\": \"%s@%u\",\n\t\t  ",
+		       iter == modeset_list ? "" : ",", iter->conn, iter->crtc, iter->mode.name,
+		       iter->mode.vrefresh);
+		bench_setcrtc(fd, iter);
+		printf(",\n\t\t  ");
+		bench_flip(fd, iter);
+		printf(" }");
+		fflush(stdout);
+	}
+	printf("\n\t]\n}\n");
 
 	/* cleanup everything */
 	modeset_cleanup(fd);
@@ -581,75 +633,268 @@ out_return:
 }
 
 /*
- * A short helper function to compute a changing color value. No need to
- * understand it.
+ * The benchmark: bench_fill() measures how fast pixels get into the mapped
+ * buffer, bench_setcrtc() and bench_flip() time the ioctls on one connector.
+ * Every measurement runs for bench_duration seconds. The results go to stdout
+ * as JSON, all other messages go to stderr.
  */
 
-static uint8_t next_color(bool *up, uint8_t cur, unsigned int mod)
+#define BENCH_MAX_THREADS 64
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The fill methods are the per pixel loop this example used to have, the fill
+ * kernel of every SIMD level the CPU supports, and pattern_draw() which fills
+ * one row and copies it into all others.
+ */
+
+enum fill_method {
+	FILL_PIXEL,
+	FILL_KERNEL,
+	FILL_ROWS,
+};
+
+static const struct kernel_set *fill_sets[] = {
+	&kernels_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+	&kernels_sse2,
+	&kernels_avx2,
+	&kernels_avx512,
+#endif
+#ifdef __aarch64__
+	&kernels_neon,
+#endif
+};
+
+/* Each thread fills its own band of rows until the time is over */
+struct fill_job {
+	pthread_t thread;
+	struct modeset_dev *dev;
+	enum fill_method method;
+	void (*fill)(uint32_t *dst, uint32_t color, size_t count);
+	uint32_t first_row;
+	uint32_t rows;
+	double end;
+	uint64_t bytes;
+};
+
+static void *fill_thread(void *arg)
+{
+	struct fill_job *job = arg;
+	struct modeset_dev *dev = job->dev;
+	uint8_t *base = dev->map + (size_t)dev->stride * job->first_row;
+	struct pattern pattern;
+	uint32_t color = 0;
+	unsigned int j, k;
+
+	pattern_parse("solid", &pattern);
+	do {
+		/* another gray on every pass, so the progress can be seen */
+		color = (color + 0x010101) & 0xffffff;
+
+		switch (job->method) {
+		case FILL_PIXEL:
+			for (j = 0; j < job->rows; ++j) {
+				for (k = 0; k < dev->width; ++k)
+					*(uint32_t *)&base[dev->stride * j + k * 4] = color;
+			}
+			break;
+		case FILL_KERNEL:
+			for (j = 0; j < job->rows; ++j)
+				job->fill((uint32_t *)&base[dev->stride * j], color, dev->width);
+			break;
+		case FILL_ROWS:
+			pattern.color = color;
+			pattern_draw(&pattern, base, dev->stride, dev->width, job->rows);
+			break;
+		}
+		job->bytes += (uint64_t)job->rows * dev->width * 4;
+	} while (bench_now() < job->end);
+
+	return NULL;
+}
+
+static void bench_fill_run(struct modeset_dev *dev, const char *name, enum fill_method method,
+			   void (*fill)(uint32_t *dst, uint32_t color, size_t count),
+			   unsigned int threads, bool first)
+{
+	struct fill_job jobs[BENCH_MAX_THREADS];
+	uint64_t bytes = 0;
+	double start;
+	unsigned int i;
+
+	memset(jobs, 0, sizeof(jobs));
+	start = bench_now();
+	for (i = 0; i < threads; ++i) {
+		jobs[i].dev = dev;
+		jobs[i].method = method;
+		jobs[i].fill = fill;
+		jobs[i].first_row = dev->height * i / threads;
+		jobs[i].rows = dev->height * (i + 1) / threads - jobs[i].first_row;
+		jobs[i].end = start + bench_duration;
+		if (pthread_create(&jobs[i].thread, NULL, fill_thread, &jobs[i])) {
+			fprintf(stderr, "cannot create fill thread (%d): %m\n", errno);
+			break;
+		}
+	}
+	threads = i;
+	for (i = 0; i < threads; ++i) {
+		pthread_join(jobs[i].thread, NULL);
+		bytes += jobs[i].bytes;
+	}
+
+	printf("%s\n\t\t\t{ \"method\": \"%s\", \"threads\": %u, \"gbps\": %.3f }", first ? "" : ",",
+	       name, threads, bytes / (bench_now() - start) / 1e9);
+	fflush(stdout);
+}
+
+static void bench_fill(struct modeset_dev *dev)
 {
-	uint8_t next;
+	unsigned int threads, cpus;
+	char name[32];
+	bool first = true;
+	size_t i;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		cpus = 1;
+	if (cpus > BENCH_MAX_THREADS)
+		cpus = BENCH_MAX_THREADS;
+
+	/* 1, 2, 4, ... threads and one per CPU */
+	for (threads = 1;; threads *= 2) {
+		if (threads > cpus)
+			threads = cpus;
+
+		bench_fill_run(dev, "pixel", FILL_PIXEL, NULL, threads, first);
+		first = false;
+		for (i = 0; i < sizeof(fill_sets) / sizeof(fill_sets[0]); ++i) {
+			if (!fill_sets[i]->ops.fill || !fill_sets[i]->supported())
+				continue;
+			snprintf(name, sizeof(name), "fill-%s", fill_sets[i]->name);
+			bench_fill_run(dev, name, FILL_KERNEL, fill_sets[i]->ops.fill, threads, first);
+		}
+		bench_fill_run(dev, "rows", FILL_ROWS, NULL, threads, first);
 
-	next = cur + (*up ? 1 : -1) * (rand() % mod);
-	if ((*up && next < cur) || (!*up && next > cur)) {
-		*up = !*up;
-		next = cur;
+		if (threads == cpus)
+			break;
 	}
+}
 
-	return next;
+/*
+ * bench_setcrtc(): Sets the same mode and framebuffer again and again. Drivers
+ * with atomic modesetting turn this into a commit which waits for the next
+ * vblank, the others may reprogram the whole pipe.
+ */
+
+static void bench_setcrtc(int fd, struct modeset_dev *dev)
+{
+	double start, t, min = 0, max = 0, total = 0;
+	unsigned int count = 0;
+	int ret;
+
+	start = bench_now();
+	do {
+		t = bench_now();
+		ret = drmModeSetCrtc(fd, dev->crtc, dev->fb, 0, 0, &dev->conn, 1, &dev->mode);
+		if (ret) {
+			printf("\"setcrtc\": { \"error\": %d }", errno);
+			return;
+		}
+		t = bench_now() - t;
+
+		if (count == 0 || t < min)
+			min = t;
+		if (t > max)
+			max = t;
+		total += t;
+		count++;
+	} while (bench_now() < start + bench_duration);
+
+	printf("\"setcrtc\": { \"count\": %u, \"mean_us\": %.1f, \"min_us\": %.1f, \"max_us\": %.1f }",
+	       count, total / count * 1e6, min * 1e6, max * 1e6);
 }
 
 /*
- * modeset_draw(): This draws a solid color into all configured framebuffers.
- * Every 100ms the color changes to a slightly different color so we get some
- * kind of smoothly changing color-gradient.
- *
- * The color calculation can be ignored as it is pretty boring. So the
- * interesting stuff is iterating over "modeset_list" and then through all lines
- * and width. We then set each pixel individually to the current color.
- *
- * We do this 50 times as we sleep 100ms after each redraw round. This makes
- * 50*100ms = 5000ms = 5s so it takes about 5seconds to finish this loop.
- *
- * Please note that we draw directly into the framebuffer. This means that you
- * will see flickering as the monitor might refresh while we redraw the screen.
- * To avoid this you would need to use two framebuffers and a call to
- * drmModeSetCrtc() to switch between both buffers.
- * You can also use drmModePageFlip() to do a vsync'ed pageflip. But this is
- * beyond the scope of this document.
+ * bench_flip(): Schedules a page flip as soon as the previous one completed, so
+ * the rate is the refresh rate unless the driver misses vblanks. The buffer is
+ * flipped to itself, the driver goes through the same work anyway. The rate and
+ * the longest interval come from the vblank timestamps of the flip events.
  */
 
-static void modeset_draw(void)
+struct flip_state {
+	unsigned int count;
+	double first;
+	double last;
+	double max_interval;
+	bool pending;
+};
+
+static void flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+			 void *data)
 {
-	uint8_t r, g, b;
-	bool r_up, g_up, b_up;
-	unsigned int i, j, k, off;
-	struct modeset_dev *iter;
+	struct flip_state *state = data;
+	double t = tv_sec + tv_usec / 1e6;
+
+	if (state->count == 0)
+		state->first = t;
+	else if (t - state->last > state->max_interval)
+		state->max_interval = t - state->last;
+	state->last = t;
+	state->count++;
+	state->pending = false;
+}
 
-	while (true) {
-		srand(time(NULL));
-		r = rand() % 0xff;
-		g = rand() % 0xff;
-		b = rand() % 0xff;
-		r_up = g_up = b_up = true;
+static void bench_flip(int fd, struct modeset_dev *dev)
+{
+	drmEventContext ev;
+	struct flip_state state;
+	struct pollfd pfd;
+	double end;
+	int ret;
 
-		for (i = 0; i < 50; ++i) {
-			r = next_color(&r_up, r, 20);
-			g = next_color(&g_up, g, 10);
-			b = next_color(&b_up, b, 5);
+	memset(&ev, 0, sizeof(ev));
+	ev.version = 2;
+	ev.page_flip_handler = flip_handler;
+	memset(&state, 0, sizeof(state));
+	pfd.fd = fd;
+	pfd.events = POLLIN;
 
-			for (iter = modeset_list; iter; iter = iter->next) {
-				for (j = 0; j < iter->height; ++j) {
-					for (k = 0; k < iter->width; ++k) {
-						off = iter->stride * j + k * 4;
-						*(uint32_t *)&iter->map[off] =
-							(r << 16) | (g << 8) | b;
-					}
-				}
-			}
+	end = bench_now() + bench_duration;
+	while (bench_now() < end) {
+		ret = drmModePageFlip(fd, dev->crtc, dev->fb, DRM_MODE_PAGE_FLIP_EVENT, &state);
+		if (ret) {
+			printf("\"flip\": { \"error\": %d }", errno);
+			return;
+		}
 
-			// usleep(100000);
+		state.pending = true;
+		while (state.pending) {
+			ret = poll(&pfd, 1, 1000);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret <= 0) {
+				printf("\"flip\": { \"error\": %d }", ret ? errno : ETIMEDOUT);
+				return;
+			}
+			drmHandleEvent(fd, &ev);
 		}
 	}
+
+	/* Without two different timestamps there is no rate, and JSON has no inf or nan */
+	printf("\"flip\": { \"count\": %u, \"rate\": ", state.count);
+	if (state.count > 1 && state.last > state.first)
+		printf("%.3f", (state.count - 1) / (state.last - state.first));
+	else
+		printf("null");
+	printf(", \"max_interval_us\": %.1f }", state.max_interval * 1e6);
 }
 
 /*
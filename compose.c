@@ -0,0 +1,498 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "kernels.h"
+#include "blit.h"
+#include "compose.h"
+
+int compositor_init(struct compositor *comp, struct framebuffer *fb)
+{
+	uint32_t pitch = fb->dumb_framebuffer.pitch;
+
+	memset(comp, 0, sizeof(*comp));
+	comp->fb = fb;
+	comp->shown_id = fb->buffer_id;
+
+	if (planes_init(fb, &comp->planes)) {
+		print_verbose("No planes available, composing everything on the CPU\n");
+	} else if (!comp->planes.atomic) {
+		print_verbose("No atomic modesetting, composing everything on the CPU\n");
+	}
+
+	comp->background = malloc((size_t)fb->virt_x * fb->virt_y * 4);
+	if (!comp->background) {
+		planes_release(&comp->planes);
+		return -ENOMEM;
+	}
+
+	/* Whatever is currently shown becomes the background */
+	for (int y = 0; y < fb->virt_y; y++)
+		memcpy(&comp->background[y * fb->virt_x], &fb->data[y * pitch], fb->virt_x * 4);
+
+	return 0;
+}
+
+static void free_surface(struct compositor *comp, struct surface *s)
+{
+	destroy_dumb_buffer(comp->fb->fd, &s->buf);
+	free(s->pixels);
+	free(s);
+}
+
+void compositor_damage(struct compositor *comp, int32_t x, int32_t y, uint32_t w, uint32_t h)
+{
+	struct damage *d = &comp->damage;
+
+	if (!w || !h)
+		return;
+
+	if (d->x0 >= d->x1) {
+		d->x0 = x;
+		d->y0 = y;
+		d->x1 = x + w;
+		d->y1 = y + h;
+		return;
+	}
+
+	if (x < d->x0)
+		d->x0 = x;
+	if (y < d->y0)
+		d->y0 = y;
+	if (x + (int32_t)w > d->x1)
+		d->x1 = x + w;
+	if (y + (int32_t)h > d->y1)
+		d->y1 = y + h;
+}
+
+struct surface *compositor_find_surface(struct compositor *comp, uint32_t id)
+{
+	for (struct surface *s = comp->surfaces; s; s = s->next) {
+		if (s->id == id)
+			return s;
+	}
+
+	return 0;
+}
+
+struct surface *compositor_get_surface(struct compositor *comp, uint32_t id, uint32_t width,
+				       uint32_t height)
+{
+	struct surface *s = compositor_find_surface(comp, id);
+
+	if (!s) {
+		struct surface **tail = &comp->surfaces;
+
+		s = calloc(1, sizeof(*s));
+		if (!s)
+			return 0;
+		s->id = id;
+
+		/* New surfaces are stacked on top */
+		while (*tail)
+			tail = &(*tail)->next;
+		*tail = s;
+	}
+
+	if (s->rect.w != width || s->rect.h != height) {
+		uint32_t *pixels = realloc(s->pixels, (size_t)width * height * 4);
+		if (!pixels) {
+			compositor_remove_surface(comp, id);
+			return 0;
+		}
+
+		s->pixels = pixels;
+		s->rect.w = width;
+		s->rect.h = height;
+		/* The scanout copy has the wrong size now */
+		destroy_dumb_buffer(comp->fb->fd, &s->buf);
+		comp->relayout = 1;
+	}
+
+	s->content_dirty = 1;
+
+	return s;
+}
+
+void compositor_move_surface(struct compositor *comp, struct surface *s, int32_t x, int32_t y)
+{
+	s->rect.x = x;
+	s->rect.y = y;
+
+	if (s->plane)
+		comp->planes_dirty = 1;
+}
+
+void compositor_remove_surface(struct compositor *comp, uint32_t id)
+{
+	for (struct surface **s = &comp->surfaces; *s; s = &(*s)->next) {
+		struct surface *found = *s;
+
+		if (found->id != id)
+			continue;
+
+		*s = found->next;
+		if (found->plane) {
+			found->plane->used = 0;
+			comp->planes_dirty = 1;
+		}
+		compositor_damage(comp, found->shown.x, found->shown.y, found->shown.w,
+				  found->shown.h);
+		free_surface(comp, found);
+		return;
+	}
+}
+
+static void upload_surface(struct surface *s)
+{
+	for (uint32_t y = 0; y < s->rect.h; y++)
+		memcpy(&s->buf.data[y * s->buf.pitch], &s->pixels[y * s->rect.w], s->rect.w * 4);
+}
+
+static int add_surface_state(struct compositor *comp, drmModeAtomicReqPtr req, struct surface *s)
+{
+	struct plane_rect src = { 0, 0, s->rect.w, s->rect.h };
+	/* Surfaces are placed in the buffer, planes relative to the visible area */
+	struct plane_rect dst = { s->rect.x - comp->fb->pan_x, s->rect.y - comp->fb->pan_y,
+				  s->rect.w, s->rect.h };
+	int err;
+
+	err = plane_add_state(req, s->plane, comp->fb->crtc->crtc_id, s->buf.fb_id, &src, &dst);
+	if (!err && s->plane->prop_zpos &&
+	    drmModeAtomicAddProperty(req, s->plane->id, s->plane->prop_zpos, s->zpos) < 0)
+		err = -ENOMEM;
+
+	return err;
+}
+
+/* Requests are built before, DRM master is only held for the commit itself */
+static int atomic_commit(struct compositor *comp, drmModeAtomicReqPtr req, uint32_t flags)
+{
+	int err;
+
+	err = master_acquire(comp->fb);
+	if (err)
+		return err;
+	err = drmModeAtomicCommit(comp->fb->fd, req, flags, 0);
+	master_release(comp->fb);
+
+	return err;
+}
+
+/*
+ * Put as many surfaces as possible on their own planes, starting with the topmost one. Planes are
+ * always scanned out above the primary plane, so as soon as one surface does not fit all surfaces
+ * below it have to be composed on the CPU as well to keep the stacking order.
+ */
+static void assign_planes(struct compositor *comp)
+{
+	struct plane_set *set = &comp->planes;
+	struct surface **stack;
+	drmModeAtomicReqPtr req;
+	uint32_t count = 0;
+	uint32_t placed = 0;
+
+	comp->relayout = 0;
+	comp->planes_dirty = 1;
+
+	for (struct surface *s = comp->surfaces; s; s = s->next) {
+		s->plane = 0;
+		count++;
+	}
+	for (uint32_t i = 0; i < set->count; i++)
+		set->planes[i].used = 0;
+
+	if (!set->atomic || !count)
+		goto done;
+
+	stack = malloc(count * sizeof(*stack));
+	req = drmModeAtomicAlloc();
+	if (!stack || !req) {
+		free(stack);
+		drmModeAtomicFree(req);
+		goto done;
+	}
+
+	count = 0;
+	for (struct surface *s = comp->surfaces; s; s = s->next)
+		stack[count++] = s;
+
+	while (count--) {
+		struct surface *s = stack[count];
+
+		if (!s->buf.data) {
+			if (create_dumb_buffer(comp->fb->fd, s->rect.w, s->rect.h,
+					       DRM_FORMAT_ARGB8888, &s->buf))
+				break;
+			upload_surface(s);
+			s->content_dirty = 0;
+		}
+
+		for (uint32_t i = 0; i < set->count; i++) {
+			struct plane *plane = &set->planes[i];
+			int cursor;
+
+			if (plane == set->primary || plane->reserved || plane->used || !plane->argb)
+				continue;
+
+			cursor = drmModeAtomicGetCursor(req);
+			s->plane = plane;
+			s->zpos = plane->zpos_max >= placed ? plane->zpos_max - placed : 0;
+			if (!add_surface_state(comp, req, s) &&
+			    !atomic_commit(comp, req, DRM_MODE_ATOMIC_TEST_ONLY)) {
+				plane->used = 1;
+				placed++;
+				break;
+			}
+
+			drmModeAtomicSetCursor(req, cursor);
+			s->plane = 0;
+		}
+
+		if (!s->plane)
+			break;
+
+		print_verbose("Surface %u on %s plane %u\n", s->id, plane_type_name(s->plane->type),
+			      s->plane->id);
+	}
+
+	drmModeAtomicFree(req);
+	free(stack);
+
+done:
+	/* Surfaces which are composed on the CPU don't need a scanout copy */
+	for (struct surface *s = comp->surfaces; s; s = s->next) {
+		if (!s->plane)
+			destroy_dumb_buffer(comp->fb->fd, &s->buf);
+	}
+}
+
+static int commit_planes(struct compositor *comp)
+{
+	struct plane_set *set = &comp->planes;
+	drmModeAtomicReqPtr req;
+	int err = 0;
+	int changes = 0;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	for (struct surface *s = comp->surfaces; s && !err; s = s->next) {
+		if (s->plane) {
+			err = add_surface_state(comp, req, s);
+			changes++;
+		}
+	}
+
+	for (uint32_t i = 0; i < set->count && !err; i++) {
+		struct plane *plane = &set->planes[i];
+
+		if (plane->active && !plane->used && !plane->reserved) {
+			err = plane_add_disable(req, plane);
+			changes++;
+		}
+	}
+
+	if (!err && changes)
+		err = atomic_commit(comp, req, 0);
+
+	if (!err) {
+		for (uint32_t i = 0; i < set->count; i++)
+			set->planes[i].active = set->planes[i].used;
+		comp->planes_dirty = 0;
+	}
+
+	drmModeAtomicFree(req);
+
+	return err;
+}
+
+void compositor_release(struct compositor *comp)
+{
+	struct surface *s;
+
+	/* Take all surfaces off their planes before their buffers go away */
+	for (s = comp->surfaces; s; s = s->next)
+		s->plane = 0;
+	for (uint32_t i = 0; i < comp->planes.count; i++)
+		comp->planes.planes[i].used = 0;
+
+	if (comp->planes.atomic)
+		commit_planes(comp);
+
+	while ((s = comp->surfaces)) {
+		comp->surfaces = s->next;
+		free_surface(comp, s);
+	}
+
+	free(comp->background);
+	planes_release(&comp->planes);
+	memset(comp, 0, sizeof(*comp));
+}
+
+static void compose_damage(struct compositor *comp)
+{
+	struct framebuffer *fb = comp->fb;
+	uint32_t pitch = fb->dumb_framebuffer.pitch;
+	struct damage d = comp->damage;
+
+	comp->damage.x0 = comp->damage.x1 = 0;
+
+	if (d.x0 < 0)
+		d.x0 = 0;
+	if (d.y0 < 0)
+		d.y0 = 0;
+	if (d.x1 > fb->virt_x)
+		d.x1 = fb->virt_x;
+	if (d.y1 > fb->virt_y)
+		d.y1 = fb->virt_y;
+	if (d.x0 >= d.x1 || d.y0 >= d.y1)
+		return;
+
+	blit(&fb->data[d.y0 * pitch + d.x0 * 4], pitch,
+	     (const uint8_t *)&comp->background[d.y0 * fb->virt_x + d.x0], fb->virt_x * 4,
+	     (d.x1 - d.x0) * 4, d.y1 - d.y0);
+
+	for (struct surface *s = comp->surfaces; s; s = s->next) {
+		int32_t x0, y0, x1, y1;
+
+		if (s->plane)
+			continue;
+
+		x0 = s->rect.x > d.x0 ? s->rect.x : d.x0;
+		y0 = s->rect.y > d.y0 ? s->rect.y : d.y0;
+		x1 = s->rect.x + (int32_t)s->rect.w < d.x1 ? s->rect.x + (int32_t)s->rect.w : d.x1;
+		y1 = s->rect.y + (int32_t)s->rect.h < d.y1 ? s->rect.y + (int32_t)s->rect.h : d.y1;
+
+		for (int32_t y = y0; y < y1 && x0 < x1; y++)
+			kernels.blend((uint32_t *)&fb->data[y * pitch + x0 * 4],
+				      &s->pixels[(y - s->rect.y) * s->rect.w + (x0 - s->rect.x)],
+				      x1 - x0);
+	}
+}
+
+/* Pan the visible area over a buffer which is larger than the mode */
+int compositor_pan(struct compositor *comp, uint16_t x, uint16_t y)
+{
+	struct framebuffer *fb = comp->fb;
+	int err;
+
+	if (x > fb->virt_x - fb->res_x)
+		x = fb->virt_x - fb->res_x;
+	if (y > fb->virt_y - fb->res_y)
+		y = fb->virt_y - fb->res_y;
+
+	err = planes_scanout(fb, &comp->planes, comp->shown_id, x, y);
+	if (err)
+		return err;
+
+	fb->pan_x = x;
+	fb->pan_y = y;
+
+	/* Surfaces on planes have to follow the content */
+	for (struct surface *s = comp->surfaces; s; s = s->next) {
+		if (s->plane)
+			comp->planes_dirty = 1;
+	}
+
+	return compositor_present(comp);
+}
+
+int compositor_present(struct compositor *comp)
+{
+	int err = 0;
+
+	if (comp->relayout || comp->planes_dirty) {
+		if (comp->relayout)
+			assign_planes(comp);
+
+		/* A plane may refuse a new position, e.g. partially off screen */
+		if (commit_planes(comp)) {
+			assign_planes(comp);
+			err = commit_planes(comp);
+		}
+	}
+
+	for (struct surface *s = comp->surfaces; s; s = s->next) {
+		if (s->plane) {
+			if (s->content_dirty)
+				upload_surface(s);
+			/* Remove what was composed before the surface moved to a plane */
+			compositor_damage(comp, s->shown.x, s->shown.y, s->shown.w, s->shown.h);
+			s->shown.w = s->shown.h = 0;
+		} else if (s->content_dirty || memcmp(&s->shown, &s->rect, sizeof(s->rect))) {
+			compositor_damage(comp, s->shown.x, s->shown.y, s->shown.w, s->shown.h);
+			compositor_damage(comp, s->rect.x, s->rect.y, s->rect.w, s->rect.h);
+			s->shown = s->rect;
+		}
+		s->content_dirty = 0;
+	}
+
+	/* The primary buffer wasn't updated while another buffer was shown */
+	if (comp->shown_id != comp->fb->buffer_id && comp->damage.x0 < comp->damage.x1) {
+		struct framebuffer *fb = comp->fb;
+
+		compositor_damage(comp, 0, 0, fb->virt_x, fb->virt_y);
+		compose_damage(comp);
+
+		err = planes_scanout(fb, &comp->planes, fb->buffer_id, fb->pan_x, fb->pan_y);
+		if (!err)
+			comp->shown_id = fb->buffer_id;
+
+		return err;
+	}
+
+	compose_damage(comp);
+
+	return err;
+}
+
+/* Scan out a buffer which already contains the complete background, e.g. a cached frame */
+int compositor_show_buffer(struct compositor *comp, uint32_t buffer_id)
+{
+	struct framebuffer *fb = comp->fb;
+	int err;
+
+	if (comp->shown_id != buffer_id) {
+		err = planes_scanout(fb, &comp->planes, buffer_id, fb->pan_x, fb->pan_y);
+		if (err)
+			return err;
+		comp->shown_id = buffer_id;
+	}
+
+	comp->damage.x0 = comp->damage.x1 = 0;
+
+	return compositor_present(comp);
+}
+
+uint32_t compositor_cpu_surfaces(struct compositor *comp)
+{
+	uint32_t count = 0;
+
+	for (struct surface *s = comp->surfaces; s; s = s->next) {
+		if (!s->plane)
+			count++;
+	}
+
+	return count;
+}
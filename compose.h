@@ -0,0 +1,79 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef COMPOSE_H
+#define COMPOSE_H
+
+#include <stdint.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+#include "planes.h"
+
+struct surface {
+	struct surface *next;
+	uint32_t id;
+	/* Requested position in the buffer and size */
+	struct plane_rect rect;
+	/* Premultiplied ARGB8888, rect.w * rect.h pixels */
+	uint32_t *pixels;
+	int content_dirty;
+	/* Scanout copy of pixels while the surface sits on its own plane */
+	struct dumb_buffer buf;
+	struct plane *plane;
+	uint64_t zpos;
+	/* Area the surface covered when it was last blended into the primary buffer */
+	struct plane_rect shown;
+};
+
+struct damage {
+	int32_t x0;
+	int32_t y0;
+	int32_t x1;
+	int32_t y1;
+};
+
+struct compositor {
+	struct framebuffer *fb;
+	struct plane_set planes;
+	/* Content below all surfaces, virt_x * virt_y XRGB8888 pixels */
+	uint32_t *background;
+	/* Ordered from bottom to top */
+	struct surface *surfaces;
+	int relayout;
+	int planes_dirty;
+	struct damage damage;
+	/* Buffer on the primary plane, only the framebuffer's own buffer is composed into */
+	uint32_t shown_id;
+};
+
+int compositor_init(struct compositor *comp, struct framebuffer *fb);
+void compositor_release(struct compositor *comp);
+
+void compositor_damage(struct compositor *comp, int32_t x, int32_t y, uint32_t w, uint32_t h);
+
+struct surface *compositor_get_surface(struct compositor *comp, uint32_t id, uint32_t width,
+				       uint32_t height);
+struct surface *compositor_find_surface(struct compositor *comp, uint32_t id);
+void compositor_move_surface(struct compositor *comp, struct surface *s, int32_t x, int32_t y);
+void compositor_remove_surface(struct compositor *comp, uint32_t id);
+
+int compositor_pan(struct compositor *comp, uint16_t x, uint16_t y);
+int compositor_present(struct compositor *comp);
+int compositor_show_buffer(struct compositor *comp, uint32_t buffer_id);
+uint32_t compositor_cpu_surfaces(struct compositor *comp);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Configuration file of the still image mode. One "key = value" per line, '#' starts a comment:
+ *
+ *   image = /srv/kiosk/screen.qoi
+ *   scale = fit          # center, stretch or fit
+ *   format = XRGB8888    # or RGB565
+ *   mode = 1920x1080@60  # preferred mode if not set
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "config.h"
+
+static char *trim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1]))
+		*--end = '\0';
+
+	return s;
+}
+
+static int parse_option(struct display_config *config, const char *key, const char *value)
+{
+	unsigned int x, y, refresh = 0;
+
+	if (strcmp(key, "image") == 0) {
+		snprintf(config->image, sizeof(config->image), "%s", value);
+	} else if (strcmp(key, "scale") == 0) {
+		if (strcmp(value, "center") == 0)
+			config->scale = IMAGE_CENTER;
+		else if (strcmp(value, "stretch") == 0)
+			config->scale = IMAGE_STRETCH;
+		else if (strcmp(value, "fit") == 0)
+			config->scale = IMAGE_FIT;
+		else
+			return -EINVAL;
+	} else if (strcmp(key, "format") == 0) {
+		if (strcasecmp(value, "XRGB8888") == 0)
+			config->format = DRM_FORMAT_XRGB8888;
+		else if (strcasecmp(value, "RGB565") == 0)
+			config->format = DRM_FORMAT_RGB565;
+		else
+			return -EINVAL;
+	} else if (strcmp(key, "mode") == 0) {
+		if (sscanf(value, "%ux%u@%u", &x, &y, &refresh) < 2 || !x || !y ||
+		    x > UINT16_MAX || y > UINT16_MAX)
+			return -EINVAL;
+		config->mode_x = x;
+		config->mode_y = y;
+		config->refresh = refresh;
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Only replaces config if the whole file is valid */
+int config_load(const char *path, struct display_config *config)
+{
+	struct display_config new;
+	char line[4352];
+	int number = 0;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (!file) {
+		printf("Could not open config %s\n", path);
+		return -errno;
+	}
+
+	memset(&new, 0, sizeof(new));
+	new.scale = IMAGE_CENTER;
+	new.format = DRM_FORMAT_XRGB8888;
+
+	while (fgets(line, sizeof(line), file)) {
+		char *comment = strchr(line, '#');
+		char *key, *value;
+
+		number++;
+		if (comment)
+			*comment = '\0';
+		key = trim(line);
+		if (!*key)
+			continue;
+
+		value = strchr(key, '=');
+		if (value)
+			*value++ = '\0';
+		if (!value || parse_option(&new, trim(key), trim(value))) {
+			printf("%s:%d: invalid line\n", path, number);
+			fclose(file);
+			return -EINVAL;
+		}
+	}
+	fclose(file);
+
+	*config = new;
+
+	return 0;
+}
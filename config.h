@@ -0,0 +1,38 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+#include "image.h"
+
+/* Settings of the still image mode, reloaded on SIGHUP */
+struct display_config {
+	/* Image file, empty for the built-in picture */
+	char image[4096];
+	enum image_scale scale;
+	/* DRM_FORMAT_XRGB8888 or DRM_FORMAT_RGB565 */
+	uint32_t format;
+	/* Requested mode, 0 for the preferred one */
+	uint16_t mode_x;
+	uint16_t mode_y;
+	uint32_t refresh;
+};
+
+int config_load(const char *path, struct display_config *config);
+
+#endif
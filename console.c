@@ -0,0 +1,259 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Text console which shows the lines read from stdin. Rendered lines are kept in a ring of slots
+ * inside a buffer which is almost twice as high as the screen. Every slot except the last one is
+ * mirrored to the second half, so the last lines are always contiguous in memory and scrolling is
+ * just a change of the scanout position. A new line costs one line render and a pan.
+ *
+ *   slot 0 .. M-1         ring of M = lines + 1 text lines
+ *   slot M .. 2M-2        mirror of slot 0 .. M-2
+ *
+ * The slot after the newest line is kept empty, it shows up below the last full line when the
+ * screen height isn't a multiple of the line height.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+#include "planes.h"
+#include "font.h"
+#include "console.h"
+
+#define CONSOLE_FG 0x00c0c0c0
+#define CONSOLE_BG 0x00000000
+/* Show new lines at least at this interval while input keeps coming */
+#define CONSOLE_PAN_INTERVAL_NS 16000000
+
+struct console {
+	struct framebuffer *fb;
+	struct plane_set planes;
+	struct dumb_buffer ring;
+	const struct glyph_atlas *atlas;
+	uint32_t columns;
+	/* Number of complete lines on the screen */
+	uint32_t lines;
+	uint32_t slots;
+	uint64_t count;
+	char *text;
+	uint32_t length;
+};
+
+static uint8_t *slot_row(struct console *con, uint32_t slot, uint32_t y)
+{
+	return &con->ring.data[(slot * con->atlas->cell_h + y) * con->ring.pitch];
+}
+
+static void clear_slot(struct console *con, uint32_t slot)
+{
+	for (uint32_t y = 0; y < con->atlas->cell_h; y++) {
+		uint32_t *row = (uint32_t *)slot_row(con, slot, y);
+
+		for (uint32_t x = 0; x < con->ring.width; x++)
+			row[x] = CONSOLE_BG;
+	}
+}
+
+/* Render the pending text into the next slot */
+static void put_line(struct console *con)
+{
+	const struct glyph_atlas *atlas = con->atlas;
+	uint32_t slot = con->count % con->slots;
+	uint32_t next = (con->count + 1) % con->slots;
+	uint32_t glyph_row = atlas->cell_w * 4;
+	uint32_t used = con->length * atlas->cell_w;
+
+	for (uint32_t y = 0; y < atlas->cell_h; y++) {
+		uint8_t *row = slot_row(con, slot, y);
+
+		for (uint32_t i = 0; i < con->length; i++)
+			memcpy(&row[i * glyph_row], atlas_glyph_row(atlas, con->text[i], y),
+			       glyph_row);
+		for (uint32_t x = used; x < con->ring.width; x++)
+			((uint32_t *)row)[x] = CONSOLE_BG;
+	}
+
+	/* The last slot is never visible in the mirrored half */
+	if (slot < con->slots - 1)
+		memcpy(slot_row(con, slot + con->slots, 0), slot_row(con, slot, 0),
+		       (size_t)atlas->cell_h * con->ring.pitch);
+
+	clear_slot(con, next);
+	if (next < con->slots - 1)
+		clear_slot(con, next + con->slots);
+
+	con->count++;
+	con->length = 0;
+}
+
+static int show_lines(struct console *con)
+{
+	uint32_t top = 0;
+
+	if (con->count > con->lines)
+		top = (con->count - con->lines) % con->slots;
+
+	return planes_scanout(con->fb, &con->planes, con->ring.fb_id, 0, top * con->atlas->cell_h);
+}
+
+static void put_text(struct console *con, const char *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		char c = data[i];
+
+		if (c == '\n') {
+			put_line(con);
+			continue;
+		}
+		if (c == '\r')
+			continue;
+
+		if (c == '\t') {
+			do {
+				con->text[con->length++] = ' ';
+			} while (con->length % 8 && con->length < con->columns);
+		} else {
+			con->text[con->length++] = c;
+		}
+
+		/* Wrap long lines */
+		if (con->length == con->columns)
+			put_line(con);
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int console_loop(struct console *con)
+{
+	struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+	uint64_t shown = con->count;
+	uint64_t last_pan = now_ns();
+	char data[65536];
+	ssize_t size = 0;
+	int err = 0;
+
+	while (!terminate) {
+		size = read(STDIN_FILENO, data, sizeof(data));
+		if (size < 0 && errno == EINTR)
+			continue;
+		if (size <= 0)
+			break;
+
+		put_text(con, data, size);
+
+		/* Only pan once the input is drained, so bursts of lines cost a single flip */
+		if (con->count != shown &&
+		    (poll(&pfd, 1, 0) <= 0 || now_ns() - last_pan > CONSOLE_PAN_INTERVAL_NS)) {
+			err = show_lines(con);
+			if (err)
+				return err;
+			shown = con->count;
+			last_pan = now_ns();
+		}
+	}
+
+	if (size < 0 && !terminate) {
+		printf("Could not read from stdin (err=%d)\n", errno);
+		return -errno;
+	}
+
+	/* Show a last line without newline as well */
+	if (con->length)
+		put_line(con);
+	if (con->count != shown)
+		err = show_lines(con);
+
+	return err;
+}
+
+int run_console(struct framebuffer *fb, uint32_t scale)
+{
+	struct console con;
+	int err;
+
+	memset(&con, 0, sizeof(con));
+	con.fb = fb;
+
+	con.atlas = get_glyph_atlas(scale, CONSOLE_FG, CONSOLE_BG);
+	if (!con.atlas) {
+		printf("Invalid font scale %u\n", scale);
+		return -EINVAL;
+	}
+
+	con.columns = fb->res_x / con.atlas->cell_w;
+	con.lines = fb->res_y / con.atlas->cell_h;
+	con.slots = con.lines + 1;
+	if (!con.columns || !con.lines) {
+		printf("Font scale %u is too large for the display\n", scale);
+		return -EINVAL;
+	}
+
+	con.text = malloc(con.columns);
+	if (!con.text)
+		return -ENOMEM;
+
+	err = create_dumb_buffer(fb->fd, fb->res_x, (2 * con.slots - 1) * con.atlas->cell_h,
+				 DRM_FORMAT_XRGB8888, &con.ring);
+	if (err)
+		goto cleanup;
+
+	if (planes_init(fb, &con.planes))
+		print_verbose("No planes available, panning with SetCrtc\n");
+
+	print_verbose("Console with %u lines of %u columns\n", con.lines, con.columns);
+
+	err = show_framebuffer(fb);
+	if (!err)
+		err = show_lines(&con);
+	if (err)
+		goto cleanup;
+
+	catch_termination();
+
+	err = console_loop(&con);
+
+	/* Keep the last lines on the display like in picture mode */
+	if (!err && !terminate)
+		wait_for_termination();
+
+	/* Don't pull the ring buffer away while it is scanned out */
+	planes_scanout(fb, &con.planes, fb->buffer_id, fb->pan_x, fb->pan_y);
+
+cleanup:
+	planes_release(&con.planes);
+	destroy_dumb_buffer(fb->fd, &con.ring);
+	release_glyph_atlases();
+	free(con.text);
+
+	return err;
+}
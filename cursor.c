@@ -0,0 +1,272 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * A small sprite which is moved by the display hardware. Moving it is a single ioctl and never
+ * touches the primary framebuffer as long as the driver has a cursor plane. Without one the
+ * sprite becomes a regular surface of the compositor.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "cursor.h"
+
+static const char *cursor_mode_name(enum cursor_mode mode)
+{
+	switch (mode) {
+	case CURSOR_ATOMIC:
+		return "atomic cursor plane";
+	case CURSOR_LEGACY:
+		return "legacy cursor";
+	case CURSOR_COMPOSED:
+		return "composed";
+	}
+
+	return "INVALID";
+}
+
+int cursor_init(struct cursor *cursor, struct compositor *comp)
+{
+	struct plane_set *set = &comp->planes;
+	int fd = comp->fb->fd;
+	uint64_t width = 64;
+	uint64_t height = 64;
+
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->comp = comp;
+	cursor->mode = CURSOR_COMPOSED;
+
+	drmGetCap(fd, DRM_CAP_CURSOR_WIDTH, &width);
+	drmGetCap(fd, DRM_CAP_CURSOR_HEIGHT, &height);
+
+	if (set->atomic) {
+		for (uint32_t i = 0; i < set->count; i++) {
+			if (set->planes[i].type == DRM_PLANE_TYPE_CURSOR && set->planes[i].argb) {
+				cursor->plane = &set->planes[i];
+				break;
+			}
+		}
+	}
+
+	/* Legacy cursor ioctls are only safe as long as nobody uses the cursor plane atomically */
+	if (cursor->plane || !set->atomic) {
+		if (!create_dumb_buffer(fd, width, height, DRM_FORMAT_ARGB8888, &cursor->buf))
+			cursor->mode = cursor->plane ? CURSOR_ATOMIC : CURSOR_LEGACY;
+	}
+
+	if (cursor->mode == CURSOR_ATOMIC)
+		cursor->plane->reserved = 1;
+	else
+		cursor->plane = 0;
+
+	print_verbose("Cursor: %s %ux%u\n", cursor_mode_name(cursor->mode), cursor->buf.width,
+		      cursor->buf.height);
+
+	return 0;
+}
+
+static int commit_cursor(struct cursor *cursor)
+{
+	struct framebuffer *fb = cursor->comp->fb;
+	struct plane_rect src = { 0, 0, cursor->buf.width, cursor->buf.height };
+	struct plane_rect dst = { cursor->x - cursor->hot_x, cursor->y - cursor->hot_y,
+				  cursor->buf.width, cursor->buf.height };
+	drmModeAtomicReqPtr req = 0;
+	int err;
+
+	/* Build the request first, DRM master is only held for the commit itself */
+	if (cursor->mode == CURSOR_ATOMIC) {
+		req = drmModeAtomicAlloc();
+		if (!req)
+			return -ENOMEM;
+
+		if (cursor->visible)
+			err = plane_add_state(req, cursor->plane, fb->crtc->crtc_id,
+					      cursor->buf.fb_id, &src, &dst);
+		else
+			err = plane_add_disable(req, cursor->plane);
+		if (err) {
+			drmModeAtomicFree(req);
+			return err;
+		}
+	}
+
+	if (master_acquire(fb)) {
+		drmModeAtomicFree(req);
+		return -EACCES;
+	}
+
+	switch (cursor->mode) {
+	case CURSOR_ATOMIC:
+		err = drmModeAtomicCommit(fb->fd, req, 0, 0);
+		break;
+	case CURSOR_LEGACY:
+		err = drmModeSetCursor2(fb->fd, fb->crtc->crtc_id,
+					cursor->visible ? cursor->buf.handle : 0, cursor->buf.width,
+					cursor->buf.height, cursor->hot_x, cursor->hot_y);
+		/* Older drivers don't know about hotspots */
+		if (err == -EINVAL || err == -ENOSYS)
+			err = drmModeSetCursor(fb->fd, fb->crtc->crtc_id,
+					       cursor->visible ? cursor->buf.handle : 0,
+					       cursor->buf.width, cursor->buf.height);
+		if (!err && cursor->visible)
+			err = drmModeMoveCursor(fb->fd, fb->crtc->crtc_id, dst.x, dst.y);
+		break;
+	default:
+		err = -EINVAL;
+		break;
+	}
+
+	master_release(fb);
+	drmModeAtomicFree(req);
+
+	return err;
+}
+
+static int move_cursor(struct cursor *cursor)
+{
+	struct framebuffer *fb = cursor->comp->fb;
+	int err;
+
+	if (cursor->mode != CURSOR_LEGACY)
+		return commit_cursor(cursor);
+
+	if (master_acquire(fb))
+		return -EACCES;
+
+	err = drmModeMoveCursor(fb->fd, fb->crtc->crtc_id, cursor->x - cursor->hot_x,
+				cursor->y - cursor->hot_y);
+	master_release(fb);
+
+	return err;
+}
+
+/* Give up on the hardware cursor and let the compositor draw the sprite */
+static void fall_back_to_composition(struct cursor *cursor)
+{
+	int visible = cursor->visible;
+
+	print_verbose("Hardware cursor failed, composing the cursor\n");
+
+	if (visible) {
+		cursor->visible = 0;
+		commit_cursor(cursor);
+		cursor->visible = visible;
+	}
+
+	if (cursor->plane)
+		cursor->plane->reserved = 0;
+	cursor->plane = 0;
+	destroy_dumb_buffer(cursor->comp->fb->fd, &cursor->buf);
+	cursor->mode = CURSOR_COMPOSED;
+}
+
+static int update_composed(struct cursor *cursor, const uint32_t *pixels)
+{
+	struct compositor *comp = cursor->comp;
+	struct surface *s;
+
+	if (!cursor->visible) {
+		compositor_remove_surface(comp, CURSOR_SURFACE_ID);
+		return compositor_present(comp);
+	}
+
+	if (pixels) {
+		s = compositor_get_surface(comp, CURSOR_SURFACE_ID, cursor->width, cursor->height);
+		if (!s)
+			return -ENOMEM;
+		memcpy(s->pixels, pixels, (size_t)cursor->width * cursor->height * 4);
+	} else {
+		s = compositor_find_surface(comp, CURSOR_SURFACE_ID);
+		if (!s)
+			return 0;
+	}
+
+	/* The cursor stays in place on the screen when the buffer is panned */
+	compositor_move_surface(comp, s, comp->fb->pan_x + cursor->x - cursor->hot_x,
+				comp->fb->pan_y + cursor->y - cursor->hot_y);
+
+	return compositor_present(comp);
+}
+
+int cursor_set_image(struct cursor *cursor, const uint32_t *pixels, uint32_t width, uint32_t height,
+		     int32_t hot_x, int32_t hot_y)
+{
+	if (cursor->mode != CURSOR_COMPOSED &&
+	    (width > cursor->buf.width || height > cursor->buf.height))
+		fall_back_to_composition(cursor);
+
+	cursor->width = width;
+	cursor->height = height;
+	cursor->hot_x = hot_x;
+	cursor->hot_y = hot_y;
+	cursor->visible = 1;
+
+	if (cursor->mode == CURSOR_COMPOSED)
+		return update_composed(cursor, pixels);
+
+	memset(cursor->buf.data, 0, cursor->buf.size);
+	for (uint32_t y = 0; y < height; y++)
+		memcpy(&cursor->buf.data[y * cursor->buf.pitch], &pixels[y * width], width * 4);
+
+	if (commit_cursor(cursor)) {
+		fall_back_to_composition(cursor);
+		return update_composed(cursor, pixels);
+	}
+
+	return 0;
+}
+
+int cursor_move(struct cursor *cursor, int32_t x, int32_t y)
+{
+	cursor->x = x;
+	cursor->y = y;
+
+	if (!cursor->visible)
+		return 0;
+
+	if (cursor->mode == CURSOR_COMPOSED)
+		return update_composed(cursor, 0);
+
+	return move_cursor(cursor);
+}
+
+int cursor_hide(struct cursor *cursor)
+{
+	if (!cursor->visible)
+		return 0;
+
+	cursor->visible = 0;
+
+	if (cursor->mode == CURSOR_COMPOSED)
+		return update_composed(cursor, 0);
+
+	return commit_cursor(cursor);
+}
+
+void cursor_release(struct cursor *cursor)
+{
+	cursor_hide(cursor);
+
+	if (cursor->plane)
+		cursor->plane->reserved = 0;
+	destroy_dumb_buffer(cursor->comp->fb->fd, &cursor->buf);
+	memset(cursor, 0, sizeof(*cursor));
+}
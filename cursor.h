@@ -0,0 +1,57 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <stdint.h>
+
+#include "buffer.h"
+#include "compose.h"
+
+/* Surface id used for the cursor when it has to be composed */
+#define CURSOR_SURFACE_ID 0xffffffff
+
+enum cursor_mode {
+	CURSOR_ATOMIC,
+	CURSOR_LEGACY,
+	CURSOR_COMPOSED,
+};
+
+struct cursor {
+	struct compositor *comp;
+	enum cursor_mode mode;
+	struct plane *plane;
+	/* Sized to what the hardware expects, the image sits in the top left corner */
+	struct dumb_buffer buf;
+	uint32_t width;
+	uint32_t height;
+	int32_t hot_x;
+	int32_t hot_y;
+	int32_t x;
+	int32_t y;
+	int visible;
+};
+
+int cursor_init(struct cursor *cursor, struct compositor *comp);
+void cursor_release(struct cursor *cursor);
+
+int cursor_set_image(struct cursor *cursor, const uint32_t *pixels, uint32_t width, uint32_t height,
+		     int32_t hot_x, int32_t hot_y);
+int cursor_move(struct cursor *cursor, int32_t x, int32_t y);
+int cursor_hide(struct cursor *cursor);
+
+#endif
@@ -22,240 +22,73 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdint.h>
-
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-
-#include <libdrm/drm.h>
-#include <libdrm/drm_mode.h>
-#include <xf86drm.h>
-#include <xf86drmMode.h>
-
-#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+#include <pthread.h>
+#include <poll.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "resources.h"
+#include "buffer.h"
+#include "lease.h"
+#include "client.h"
+#include "kernels.h"
+#include "blit.h"
+#include "pattern.h"
+#include "stream.h"
+#include "console.h"
+#include "loop.h"
+#include "slideshow.h"
+#include "watch.h"
+#include "still.h"
+#include "vblank.h"
 
 extern char _picture_start[];
 extern char _picture_end[];
 
-struct framebuffer {
-	int fd;
-	uint32_t buffer_id;
-	uint16_t res_x;
-	uint16_t res_y;
-	uint8_t *data;
-	uint32_t size;
-	struct drm_mode_create_dumb dumb_framebuffer;
-	drmModeCrtcPtr crtc;
-	drmModeConnectorPtr connector;
-	drmModeModeInfoPtr resolution;
-};
-
-struct type_name {
-	unsigned int type;
-	const char *name;
-};
-
-static const struct type_name connector_type_names[] = {
-	{DRM_MODE_CONNECTOR_Unknown, "unknown"},
-	{DRM_MODE_CONNECTOR_VGA, "VGA"},
-	{DRM_MODE_CONNECTOR_DVII, "DVI-I"},
-	{DRM_MODE_CONNECTOR_DVID, "DVI-D"},
-	{DRM_MODE_CONNECTOR_DVIA, "DVI-A"},
-	{DRM_MODE_CONNECTOR_Composite, "composite"},
-	{DRM_MODE_CONNECTOR_SVIDEO, "s-video"},
-	{DRM_MODE_CONNECTOR_LVDS, "LVDS"},
-	{DRM_MODE_CONNECTOR_Component, "component"},
-	{DRM_MODE_CONNECTOR_9PinDIN, "9-pin DIN"},
-	{DRM_MODE_CONNECTOR_DisplayPort, "DP"},
-	{DRM_MODE_CONNECTOR_HDMIA, "HDMI-A"},
-	{DRM_MODE_CONNECTOR_HDMIB, "HDMI-B"},
-	{DRM_MODE_CONNECTOR_TV, "TV"},
-	{DRM_MODE_CONNECTOR_eDP, "eDP"},
-	{DRM_MODE_CONNECTOR_VIRTUAL, "Virtual"},
-	{DRM_MODE_CONNECTOR_DSI, "DSI"},
-	{DRM_MODE_CONNECTOR_DPI, "DPI"},
-};
-
-static const char *connector_type_name(unsigned int type)
-{
-	if (type < ARRAY_SIZE(connector_type_names) && type >= 0) {
-		return connector_type_names[type].name;
-	}
-
-	return "INVALID";
-}
-
-static void release_framebuffer(struct framebuffer *fb)
-{
-	if (fb->fd) {
-		/* Try to become master again, else we can't set CRTC. Then the current master needs
-		 * to reset everything. */
-		drmSetMaster(fb->fd);
-		if (fb->crtc) {
-			/* Set back to orignal frame buffer */
-			drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, fb->crtc->buffer_id, 0, 0,
-				       &fb->connector->connector_id, 1, fb->resolution);
-			drmModeFreeCrtc(fb->crtc);
-		}
-		if (fb->buffer_id)
-			drmModeFreeFB(drmModeGetFB(fb->fd, fb->buffer_id));
-		/* This will also release resolution */
-		if (fb->connector) {
-			drmModeFreeConnector(fb->connector);
-			fb->resolution = 0;
-		}
-		if (fb->dumb_framebuffer.handle)
-			ioctl(fb->fd, DRM_IOCTL_MODE_DESTROY_DUMB, fb->dumb_framebuffer);
-		close(fb->fd);
-	}
-}
-
-static int get_framebuffer(const char *dri_device, const char *connector_name,
-			   struct framebuffer *fb)
-{
-	int err;
-	int fd;
-	drmModeResPtr res;
-	drmModeEncoderPtr encoder = 0;
-
-	/* Open the dri device /dev/dri/cardX */
-	fd = open(dri_device, O_RDWR);
-	if (fd < 0) {
-		printf("Could not open dri device %s\n", dri_device);
-		return -EINVAL;
-	}
-
-	/* Get the resources of the DRM device (connectors, encoders, etc.)*/
-	res = drmModeGetResources(fd);
-	if (!res) {
-		printf("Could not get drm resources\n");
-		return -EINVAL;
-	}
-
-	/* Search the connector provided as argument */
-	drmModeConnectorPtr connector = 0;
-	for (int i = 0; i < res->count_connectors; i++) {
-		char name[32];
-
-		connector = drmModeGetConnectorCurrent(fd, res->connectors[i]);
-		if (!connector)
-			continue;
-
-		snprintf(name, sizeof(name), "%s-%u",
-			 connector_type_name(connector->connector_type),
-			 connector->connector_type_id);
-
-		if (strncmp(name, connector_name, sizeof(name)) == 0)
-			break;
-
-		drmModeFreeConnector(connector);
-		connector = 0;
-	}
-
-	if (!connector) {
-		printf("Could not find matching connector %s\n", connector_name);
-		return -EINVAL;
-	}
-
-	/* Get the preferred resolution */
-	drmModeModeInfoPtr resolution = 0;
-	for (int i = 0; i < connector->count_modes; i++) {
-		drmModeModeInfoPtr res = 0;
-		res = &connector->modes[i];
-		if (res->type & DRM_MODE_TYPE_PREFERRED)
-			resolution = res;
-	}
-
-	if (!resolution) {
-		printf("Could not find preferred resolution\n");
-		err = -EINVAL;
-		goto cleanup;
-	}
-
-	fb->dumb_framebuffer.height = resolution->vdisplay;
-	fb->dumb_framebuffer.width = resolution->hdisplay;
-	fb->dumb_framebuffer.bpp = 32;
-
-	err = ioctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &fb->dumb_framebuffer);
-	if (err) {
-		printf("Could not create dumb framebuffer (err=%d)\n", err);
-		goto cleanup;
-	}
-
-	err = drmModeAddFB(fd, resolution->hdisplay, resolution->vdisplay, 24, 32,
-			   fb->dumb_framebuffer.pitch, fb->dumb_framebuffer.handle, &fb->buffer_id);
-	if (err) {
-		printf("Could not add framebuffer to drm (err=%d)\n", err);
-		goto cleanup;
-	}
-
-	encoder = drmModeGetEncoder(fd, connector->encoder_id);
-	if (!encoder) {
-		printf("Could not get encoder\n");
-		err = -EINVAL;
-		goto cleanup;
-	}
-
-	/* Get the crtc settings */
-	fb->crtc = drmModeGetCrtc(fd, encoder->crtc_id);
-
-	struct drm_mode_map_dumb mreq;
-
-	memset(&mreq, 0, sizeof(mreq));
-	mreq.handle = fb->dumb_framebuffer.handle;
-
-	err = drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq);
-	if (err) {
-		printf("Mode map dumb framebuffer failed (err=%d)\n", err);
-		goto cleanup;
-	}
-
-	fb->data = mmap(0, fb->dumb_framebuffer.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
-			mreq.offset);
-	if (fb->data == MAP_FAILED) {
-		err = errno;
-		printf("Mode map failed (err=%d)\n", err);
-		goto cleanup;
-	}
-
-	/* Make sure we are not master anymore so that other processes can add new framebuffers as
-	 * well */
-	drmDropMaster(fd);
-
-	fb->fd = fd;
-	fb->connector = connector;
-	fb->resolution = resolution;
-
-cleanup:
-	/* We don't need the encoder and connector anymore so let's free them */
-	if (encoder)
-		drmModeFreeEncoder(encoder);
-
-	if (err)
-		release_framebuffer(fb);
-
-	return err;
-}
-
-static int verbose = 0;
-
 static void usage(void)
 {
 	printf("\ndrm-framebuffer [OPTIONS...]\n\n"
 	       "Pipe data to a framebuffer\n\n"
+	       "  -d <device> dri device, repeat for several outputs (default /dev/dri/card0)\n"
+	       "  -c <connector> connector of the last -d device (default HDMI-A-1)\n"
 	       "  -l list connectors\n"
 	       "  -r get resolution dri device and connector needs to be set\n"
+	       "  -s read frames and surfaces from stdin (stream mode)\n"
+	       "  -t show text lines from stdin (console mode)\n"
+	       "  -f <scale> font scale for the console, 1 is 8x8 pixels (default 2)\n"
+	       "  -g <width>x<height> size of the buffer to pan over, at least the resolution\n"
+	       "  -i <width>x<height> size of the frames in stream mode, may exceed the display\n"
+	       "  -o <x>,<y> position of the visible window inside larger frames\n"
+	       "  -M <MiB> cache recently shown stream frames in this much scanout memory\n"
+	       "  -U <socket> run stream mode as a daemon taking commands from clients on socket\n"
+	       "  -u <socket> send the stream commands from stdin to the daemon on socket\n"
+	       "  -p <count> preload count frames from stdin and play them in a loop\n"
+	       "  -R <fps> frame rate of the loop, default is the refresh rate\n"
+	       "  -S <dir> slideshow over the QOI and raw images in dir\n"
+	       "  -D <seconds> time each slideshow image is shown (default 5)\n"
+	       "  -X <ms> duration of the crossfade between images, 0 cuts (default 1000)\n"
+	       "  -w <path> show an image and reload it on changes, a directory shows its latest file\n"
+	       "  -C <file> show the image described by a config file, reloaded on SIGHUP\n"
+	       "  -T <file> cache the output in file and skip the connector search next time\n"
+	       "  -K <level> use SIMD kernels up to scalar, sse2, avx2, avx512 or neon, check tests them\n"
+	       "  -P <name> show a test pattern: smpte, ebu, gradient, checker, zone, box or solid\n"
+	       "  -V <seconds> measure refresh interval and jitter of the CRTC, 0 until interrupted\n"
+	       "  -A <file> time the ways of copying into the buffer once and keep the fastest in file\n"
+	       "  -H hold DRM master for the whole session instead of around each commit\n"
+	       "  -L <socket> hand out leases of single connectors to clients on socket\n"
+	       "  -E <socket> drive the connector through a lease from the manager on socket\n"
 	       "  -v do more verbose printing\n"
 	       "  -h show this message\n\n");
 }
 
-#define print_verbose(...) \
-	if (verbose)       \
-	printf(__VA_ARGS__)
-
 static int list_resources(const char *dri_device)
 {
 	int fd;
-	drmModeResPtr res;
+	int err;
+	int planes;
+	struct drm_resources res;
+	drmModeResPtr r;
 
 	fd = open(dri_device, O_RDWR);
 	if (fd < 0) {
@@ -263,54 +96,57 @@ static int list_resources(const char *dri_device)
 		return -EINVAL;
 	}
 
-	res = drmModeGetResources(fd);
-	if (!res) {
-		printf("Could not get drm resources\n");
-		return -EINVAL;
+	err = drm_resources_load(fd, &res);
+	if (err) {
+		close(fd);
+		return err;
 	}
+	r = res.res;
 
 	printf("connectors:");
-	for (int i = 0; i < res->count_connectors; i++) {
-		drmModeConnectorPtr connector = 0;
-		drmModeEncoderPtr encoder = 0;
+	for (int i = 0; i < r->count_connectors; i++) {
+		drmModeConnectorPtr connector = res.connectors[i];
+		drmModeEncoderPtr encoder;
 
-		printf("\nNumber: %d ", res->connectors[i]);
-		connector = drmModeGetConnectorCurrent(fd, res->connectors[i]);
+		printf("\nNumber: %d ", r->connectors[i]);
 		if (!connector)
 			continue;
 
-		printf("Name: %s-%u ", connector_type_name(connector->connector_type),
-		       connector->connector_type_id);
+		printf("Name: %s ", res.names[i]);
 
 		printf("Encoder: %d ", connector->encoder_id);
 
-		encoder = drmModeGetEncoder(fd, connector->encoder_id);
+		encoder = drm_resources_encoder(&res, connector->encoder_id);
 		if (!encoder)
 			continue;
 
 		printf("Crtc: %d", encoder->crtc_id);
-
-		drmModeFreeEncoder(encoder);
-		drmModeFreeConnector(connector);
 	}
 
 	printf("\nFramebuffers: ");
-	for (int i = 0; i < res->count_fbs; i++) {
-		printf("%d ", res->fbs[i]);
+	for (int i = 0; i < r->count_fbs; i++) {
+		printf("%d ", r->fbs[i]);
 	}
 
 	printf("\nCRTCs: ");
-	for (int i = 0; i < res->count_crtcs; i++) {
-		printf("%d ", res->crtcs[i]);
+	for (int i = 0; i < r->count_crtcs; i++) {
+		printf("%d ", r->crtcs[i]);
 	}
 
 	printf("\nencoders: ");
-	for (int i = 0; i < res->count_encoders; i++) {
-		printf("%d ", res->encoders[i]);
+	for (int i = 0; i < r->count_encoders; i++) {
+		printf("%d ", r->encoders[i]);
+	}
+
+	printf("\nplanes: ");
+	planes = drm_resources_load_planes(&res);
+	for (int i = 0; i < planes; i++) {
+		printf("%d ", res.plane_res->planes[i]);
 	}
 	printf("\n");
 
-	drmModeFreeResources(res);
+	drm_resources_release(&res);
+	close(fd);
 
 	return 0;
 }
@@ -319,7 +155,8 @@ static int get_resolution(const char *dri_device, const char *connector_name)
 {
 	int err = 0;
 	int fd;
-	drmModeResPtr res;
+	int index;
+	struct drm_resources res;
 
 	fd = open(dri_device, O_RDWR);
 	if (fd < 0) {
@@ -327,35 +164,19 @@ static int get_resolution(const char *dri_device, const char *connector_name)
 		return -EINVAL;
 	}
 
-	res = drmModeGetResources(fd);
-	if (!res) {
-		printf("Could not get drm resources\n");
-		return -EINVAL;
+	err = drm_resources_load(fd, &res);
+	if (err) {
+		close(fd);
+		return err;
 	}
 
 	/* Search the connector provided as argument */
-	drmModeConnectorPtr connector = 0;
-	for (int i = 0; i < res->count_connectors; i++) {
-		char name[32];
-
-		connector = drmModeGetConnectorCurrent(fd, res->connectors[i]);
-		if (!connector)
-			continue;
-
-		snprintf(name, sizeof(name), "%s-%u",
-			 connector_type_name(connector->connector_type),
-			 connector->connector_type_id);
-
-		if (strncmp(name, connector_name, sizeof(name)) == 0)
-			break;
-
-		drmModeFreeConnector(connector);
-		connector = 0;
-	}
-
+	index = drm_resources_find_connector(&res, connector_name);
+	drmModeConnectorPtr connector = index < 0 ? 0 : res.connectors[index];
 	if (!connector) {
 		printf("Could not find matching connector %s\n", connector_name);
-		return -EINVAL;
+		err = -EINVAL;
+		goto error;
 	}
 
 	/* Get the preferred resolution */
@@ -375,64 +196,389 @@ static int get_resolution(const char *dri_device, const char *connector_name)
 	printf("%ux%u\n", resolution->hdisplay, resolution->vdisplay);
 
 error:
-	drmModeFreeConnector(connector);
-	drmModeFreeResources(res);
+	drm_resources_release(&res);
 	close(fd);
 	return err;
 }
 
-static int fill_framebuffer_from_stdin(struct framebuffer *fb)
+/* Several devices can be driven at once, e.g. an integrated controller and a USB display */
+#define MAX_OUTPUTS 8
+
+struct output {
+	const char *dri_device;
+	const char *connector;
+	char topology_path[4096];
+	const char *lease_socket;
+	/* Requested buffer size and the frame size of stream mode, for the crop fallback */
+	unsigned int virt_x;
+	unsigned int virt_y;
+	int crop;
+	unsigned int input_x;
+	unsigned int input_y;
+	struct framebuffer fb;
+	int err;
+	pthread_t thread;
+	int threaded;
+};
+
+static void *setup_output(void *arg)
+{
+	struct output *output = arg;
+	const char *topology_path = output->topology_path[0] ? output->topology_path : NULL;
+	struct framebuffer *fb = &output->fb;
+
+	/* Try to scan out large frames directly, a window of them is copied if that fails */
+	memset(fb, 0, sizeof(*fb));
+	fb->virt_x = output->virt_x;
+	fb->virt_y = output->virt_y;
+	if (output->crop && output->input_x <= UINT16_MAX && output->input_y <= UINT16_MAX) {
+		if (output->input_x > output->virt_x)
+			fb->virt_x = output->input_x;
+		if (output->input_y > output->virt_y)
+			fb->virt_y = output->input_y;
+	}
+	output->err = get_framebuffer(output->dri_device, output->connector, topology_path,
+				      output->lease_socket, fb);
+	if (output->err && output->crop) {
+		print_verbose("Could not scan out the whole frame, copying the visible part\n");
+		memset(fb, 0, sizeof(*fb));
+		fb->virt_x = output->virt_x;
+		fb->virt_y = output->virt_y;
+		output->err = get_framebuffer(output->dri_device, output->connector, topology_path,
+					      output->lease_socket, fb);
+	}
+
+	return NULL;
+}
+
+/* Each device is opened, searched and gets its buffer on its own thread */
+static int setup_outputs(struct output *outputs, int count)
+{
+	int err = 0;
+
+	if (count == 1) {
+		setup_output(&outputs[0]);
+		return outputs[0].err;
+	}
+
+	for (int i = 0; i < count; i++) {
+		outputs[i].threaded = !pthread_create(&outputs[i].thread, NULL, setup_output,
+						      &outputs[i]);
+		/* Do it here, it's just slower */
+		if (!outputs[i].threaded)
+			setup_output(&outputs[i]);
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (outputs[i].threaded)
+			pthread_join(outputs[i].thread, NULL);
+		if (outputs[i].err) {
+			printf("Could not set up %s on %s\n", outputs[i].connector,
+			       outputs[i].dri_device);
+			err = outputs[i].err;
+		}
+	}
+
+	return err;
+}
+
+static int fill_framebuffer_from_stdin(struct output *outputs, int count)
 {
-	size_t total_read = 0;
 	int ret;
 
-	print_verbose("Loading image\n");
-	memcpy(&fb->data[total_read], _picture_start, _picture_end - _picture_start);
+	for (int i = 0; i < count; i++) {
+		struct framebuffer *fb = &outputs[i].fb;
+		size_t row = fb->res_x * 4;
+		size_t rows = (_picture_end - _picture_start) / row;
 
-	/* Make sure we synchronize the display with the buffer. This also works if page flips are
-	 * enabled */
-	ret = drmSetMaster(fb->fd);
-	if (ret) {
-		printf("Could not get master role for DRM.\n");
-		return ret;
+		print_verbose("Loading image\n");
+		/* The picture has the size of the mode but the buffer may be larger */
+		blit(fb->data, fb->dumb_framebuffer.pitch, (const uint8_t *)_picture_start, row, row,
+		     rows < fb->virt_y ? rows : fb->virt_y);
+
+		ret = show_framebuffer(fb);
+		if (ret)
+			return ret;
+
+		print_verbose("Sent image to framebuffer\n");
 	}
-	drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, 0, 0, 0, NULL, 0, NULL);
-	drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, fb->buffer_id, 0, 0, &fb->connector->connector_id,
-		       1, fb->resolution);
-	drmDropMaster(fb->fd);
 
-	print_verbose("Sent image to framebuffer\n");
+	wait_for_termination();
 
-	sigset_t wait_set;
-	sigemptyset(&wait_set);
-	sigaddset(&wait_set, SIGTERM);
-	sigaddset(&wait_set, SIGINT);
+	return 0;
+}
 
-	int sig;
-	sigprocmask(SIG_BLOCK, &wait_set, NULL);
-	sigwait(&wait_set, &sig);
+static void pattern_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+				 unsigned int tv_usec, void *user_data)
+{
+	int *flip_pending = user_data;
+
+	*flip_pending = 0;
+}
+
+/* Draws the next frame into the back buffer of every output and flips them all */
+static int flip_pattern(struct output *outputs, int count, const struct pattern *pattern,
+			struct dumb_buffer *back, int *flip_pending)
+{
+	drmEventContext ev = {
+		.version = 2,
+		.page_flip_handler = pattern_flip_handler,
+	};
+	int ret;
+
+	for (int i = 0; i < count; i++) {
+		struct framebuffer *fb = &outputs[i].fb;
+
+		pattern_draw(pattern, back[i].data, back[i].pitch, fb->virt_x, fb->virt_y);
+
+		ret = master_acquire(fb);
+		if (ret)
+			return ret;
+		ret = drmModePageFlip(fb->fd, fb->crtc->crtc_id, back[i].fb_id,
+				      DRM_MODE_PAGE_FLIP_EVENT, &flip_pending[i]);
+		master_release(fb);
+		if (ret) {
+			printf("Page flip failed (err=%d)\n", ret);
+			return ret;
+		}
+		flip_pending[i] = 1;
+	}
+
+	/* A signal doesn't stop the wait, the flips complete within a frame anyway */
+	for (int i = 0; i < count; i++) {
+		struct pollfd pfd = { .fd = outputs[i].fb.fd, .events = POLLIN };
+
+		while (flip_pending[i]) {
+			if (poll(&pfd, 1, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				return -errno;
+			}
+			drmHandleEvent(pfd.fd, &ev);
+		}
+	}
+
+	return 0;
+}
+
+/* The box moves one step per vblank, each output flips between its buffer and a second one */
+static int animate_pattern(struct output *outputs, int count, const struct pattern *pattern)
+{
+	struct dumb_buffer extra[MAX_OUTPUTS];
+	struct dumb_buffer shown[MAX_OUTPUTS];
+	/* The framebuffer's own buffer is on the display first */
+	struct dumb_buffer *buffers[2] = { shown, extra };
+	struct pattern next = *pattern;
+	int flip_pending[MAX_OUTPUTS];
+	int ret = 0;
+	int i;
+
+	memset(extra, 0, sizeof(extra));
+	for (i = 0; i < count; i++) {
+		struct framebuffer *fb = &outputs[i].fb;
+
+		ret = create_dumb_buffer(fb->fd, fb->virt_x, fb->virt_y, DRM_FORMAT_XRGB8888,
+					 &extra[i]);
+		if (ret)
+			goto cleanup;
+		shown[i] = (struct dumb_buffer){
+			.pitch = fb->dumb_framebuffer.pitch,
+			.fb_id = fb->buffer_id,
+			.data = fb->data,
+		};
+	}
+
+	catch_termination();
+	for (uint32_t frame = 1; !terminate; frame++) {
+		next.frame = pattern->frame + frame;
+		ret = flip_pattern(outputs, count, &next, buffers[frame & 1], flip_pending);
+		if (ret)
+			break;
+	}
+
+	/* Back to the framebuffer's own buffer before the second one is destroyed */
+	for (i = 0; i < count; i++)
+		scanout_framebuffer(&outputs[i].fb, outputs[i].fb.buffer_id, outputs[i].fb.pan_x,
+				    outputs[i].fb.pan_y);
+
+cleanup:
+	for (i = 0; i < count; i++)
+		destroy_dumb_buffer(outputs[i].fb.fd, &extra[i]);
+
+	return ret;
+}
+
+static int show_pattern(struct output *outputs, int count, const struct pattern *pattern)
+{
+	int ret;
+
+	for (int i = 0; i < count; i++) {
+		struct framebuffer *fb = &outputs[i].fb;
+
+		pattern_draw(pattern, fb->data, fb->dumb_framebuffer.pitch, fb->virt_x, fb->virt_y);
+
+		ret = show_framebuffer(fb);
+		if (ret)
+			return ret;
+	}
+
+	if (pattern->type == PATTERN_BOX)
+		return animate_pattern(outputs, count, pattern);
+
+	wait_for_termination();
 
 	return 0;
 }
 
 int main(int argc, char **argv)
 {
-	char *dri_device = "/dev/dri/card0";
-	char *connector = "HDMI-A-1";
+	struct output outputs[MAX_OUTPUTS];
+	int count = 0;
 	int c;
 	int list = 0;
 	int resolution = 0;
+	int stream = 0;
+	int text = 0;
+	unsigned int font_scale = 2;
+	unsigned int loop_frames = 0;
+	unsigned int loop_rate = 0;
+	const char *slideshow_dir = NULL;
+	unsigned int slide_hold = 5;
+	unsigned int slide_fade = 1000;
+	const char *watch_path = NULL;
+	const char *config_path = NULL;
+	const char *topology_path = NULL;
+	const char *lease_manager = NULL;
+	const char *lease_socket = NULL;
+	const char *daemon_socket = NULL;
+	const char *client_socket = NULL;
+	const char *kernel_limit = NULL;
+	const char *blit_cache = NULL;
+	const char *pattern_name = NULL;
+	int vblank = 0;
+	unsigned int vblank_seconds = 0;
+	struct pattern pattern;
+	struct framebuffer *fb;
+	unsigned int virt_x = 0;
+	unsigned int virt_y = 0;
+	struct stream_options stream_options;
 	int ret;
 
+	memset(&stream_options, 0, sizeof(stream_options));
+	memset(outputs, 0, sizeof(outputs));
+
 	opterr = 0;
-	while ((c = getopt(argc, argv, "lrhv")) != -1) {
+	while ((c = getopt(argc, argv, "d:c:lrstf:g:i:o:M:U:u:p:R:S:D:X:w:C:T:L:E:K:A:P:V:Hhv")) != -1) {
 		switch (c) {
+		case 'd':
+		case 'c':
+			/* -d starts the next output, -c names the connector of the current one */
+			if (count == 0 || (c == 'd' && outputs[count - 1].dri_device)) {
+				if (count == MAX_OUTPUTS) {
+					printf("At most %d outputs are supported\n", MAX_OUTPUTS);
+					return 1;
+				}
+				count++;
+			}
+			if (c == 'd')
+				outputs[count - 1].dri_device = optarg;
+			else
+				outputs[count - 1].connector = optarg;
+			break;
 		case 'l':
 			list = 1;
 			break;
 		case 'r':
 			resolution = 1;
 			break;
+		case 's':
+			stream = 1;
+			break;
+		case 't':
+			text = 1;
+			break;
+		case 'f':
+			font_scale = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			if (sscanf(optarg, "%ux%u", &virt_x, &virt_y) != 2 || virt_x > UINT16_MAX ||
+			    virt_y > UINT16_MAX) {
+				printf("Invalid buffer size %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'i':
+			if (sscanf(optarg, "%ux%u", &stream_options.input_x, &stream_options.input_y) != 2) {
+				printf("Invalid input size %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'o':
+			if (sscanf(optarg, "%u,%u", &stream_options.crop_x, &stream_options.crop_y) != 2) {
+				printf("Invalid crop position %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'M':
+			stream_options.cache_budget = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'p':
+			loop_frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			loop_rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			slideshow_dir = optarg;
+			break;
+		case 'D':
+			slide_hold = strtoul(optarg, NULL, 0);
+			break;
+		case 'X':
+			slide_fade = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			watch_path = optarg;
+			break;
+		case 'C':
+			config_path = optarg;
+			break;
+		case 'T':
+			topology_path = optarg;
+			break;
+		case 'A':
+			blit_cache = optarg;
+			break;
+		case 'K':
+			kernel_limit = optarg;
+			break;
+		case 'P':
+			pattern_name = optarg;
+			if (pattern_parse(pattern_name, &pattern)) {
+				printf("Unknown pattern %s\n", pattern_name);
+				return 1;
+			}
+			break;
+		case 'V':
+			vblank = 1;
+			vblank_seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			hold_master = 1;
+			break;
+		case 'U':
+			daemon_socket = optarg;
+			stream = 1;
+			break;
+		case 'u':
+			client_socket = optarg;
+			break;
+		case 'L':
+			lease_manager = optarg;
+			break;
+		case 'E':
+			lease_socket = optarg;
+			break;
 		case 'h':
 			usage();
 			return 1;
@@ -444,24 +590,110 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (list) {
-		return list_resources(dri_device);
+	if (count == 0)
+		count = 1;
+	for (int i = 0; i < count; i++) {
+		struct output *output = &outputs[i];
+
+		if (!output->dri_device)
+			output->dri_device = "/dev/dri/card0";
+		if (!output->connector)
+			output->connector = "HDMI-A-1";
+		if (topology_path && count > 1)
+			snprintf(output->topology_path, sizeof(output->topology_path), "%s.%d",
+				 topology_path, i);
+		else if (topology_path)
+			snprintf(output->topology_path, sizeof(output->topology_path), "%s",
+				 topology_path);
+		output->virt_x = virt_x;
+		output->virt_y = virt_y;
+		output->crop = stream && (stream_options.input_x > virt_x ||
+					  stream_options.input_y > virt_y);
+		output->input_x = stream_options.input_x;
+		output->input_y = stream_options.input_y;
+		output->lease_socket = lease_socket;
 	}
 
-	if (resolution) {
-		return get_resolution(dri_device, connector);
+	if (kernel_limit && strcmp(kernel_limit, "check") == 0)
+		return kernels_check() ? 1 : 0;
+	if (kernels_init(kernel_limit))
+		return 1;
+	if (verbose)
+		kernels_print();
+
+	if (client_socket)
+		return run_client(client_socket) ? 1 : 0;
+
+	if (lease_manager)
+		return run_lease_manager(outputs[0].dri_device, lease_manager) ? 1 : 0;
+
+	if (list || resolution) {
+		ret = 0;
+		for (int i = 0; i < count; i++) {
+			if (count > 1)
+				printf("%s:\n", outputs[i].dri_device);
+			if (list && list_resources(outputs[i].dri_device))
+				ret = 1;
+			else if (!list && get_resolution(outputs[i].dri_device, outputs[i].connector))
+				ret = 1;
+		}
+		return ret;
 	}
 
-	struct framebuffer fb;
-	memset(&fb, 0, sizeof(fb));
+	ret = setup_outputs(outputs, count);
+	if (ret) {
+		for (int i = 0; i < count; i++) {
+			if (!outputs[i].err)
+				release_framebuffer(&outputs[i].fb);
+		}
+		return 1;
+	}
+
+	/* The picture and the patterns go to all outputs, the other modes drive the first one */
+	fb = &outputs[0].fb;
+	if (blit_cache)
+		blit_tune(fb, outputs[0].dri_device, blit_cache);
+	if (count > 1 && (stream || text || loop_frames || slideshow_dir || watch_path || config_path ||
+			  vblank))
+		print_verbose("Using %s on %s\n", outputs[0].connector, outputs[0].dri_device);
+
 	ret = 1;
-	if (get_framebuffer(dri_device, connector, &fb) == 0) {
-		if (!fill_framebuffer_from_stdin(&fb)) {
-			// successfully shown.
+	if (vblank) {
+		if (!run_vblank(fb, vblank_seconds))
 			ret = 0;
-		}
-		release_framebuffer(&fb);
+	} else if (daemon_socket) {
+		if (!run_stream_server(fb, &stream_options, daemon_socket))
+			ret = 0;
+	} else if (stream) {
+		if (!run_stream(fb, &stream_options))
+			ret = 0;
+	} else if (text) {
+		if (!run_console(fb, font_scale))
+			ret = 0;
+	} else if (loop_frames) {
+		if (!run_loop(fb, loop_frames, loop_rate))
+			ret = 0;
+	} else if (slideshow_dir) {
+		if (!run_slideshow(fb, slideshow_dir, slide_hold * 1000, slide_fade))
+			ret = 0;
+	} else if (watch_path) {
+		if (!run_watch(fb, watch_path))
+			ret = 0;
+	} else if (config_path) {
+		if (!run_still(fb, config_path))
+			ret = 0;
+	} else if (pattern_name) {
+		if (!show_pattern(outputs, count, &pattern))
+			ret = 0;
+	} else if (!fill_framebuffer_from_stdin(outputs, count)) {
+		// successfully shown.
+		ret = 0;
 	}
+	for (int i = 0; i < count; i++)
+		release_framebuffer(&outputs[i].fb);
+
+	if (verbose)
+		master_print_stats();
 
 	return ret;
 }
@@ -0,0 +1,92 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRM_FRAMEBUFFER_H
+#define DRM_FRAMEBUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include <libdrm/drm.h>
+#include <libdrm/drm_mode.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+
+struct framebuffer {
+	int fd;
+	uint32_t buffer_id;
+	uint16_t res_x;
+	uint16_t res_y;
+	/* Size of the buffer, can be larger than the mode to pan over it */
+	uint16_t virt_x;
+	uint16_t virt_y;
+	/* Position of the visible area inside the buffer */
+	uint16_t pan_x;
+	uint16_t pan_y;
+	uint8_t *data;
+	uint32_t size;
+	struct drm_mode_create_dumb dumb_framebuffer;
+	drmModeCrtcPtr crtc;
+	/* Position of the CRTC in the resources, planes and vblanks refer to it by index */
+	uint32_t crtc_index;
+	drmModeConnectorPtr connector;
+	drmModeModeInfoPtr resolution;
+	/* DRM master is kept until exit, see hold_master */
+	int master;
+};
+
+extern int verbose;
+
+#define print_verbose(...) \
+	if (verbose)       \
+	printf(__VA_ARGS__)
+
+/* Set by libdrmfb, its entry points report errors only by their return value */
+extern int quiet;
+
+#define print_error(...) \
+	if (!quiet)      \
+	printf(__VA_ARGS__)
+
+/*
+ * DRM master is only taken around the ioctls which need it, so that other clients can share the
+ * device. With hold_master set it is taken once and kept for the whole session instead.
+ */
+extern int hold_master;
+int master_acquire(struct framebuffer *fb);
+void master_release(struct framebuffer *fb);
+void master_print_stats(void);
+
+/*
+ * Opens the device or gets a lease of the connector from the manager on lease_socket, finds the
+ * output and creates the scanout buffer. virt_x/virt_y of fb are the minimum buffer size.
+ */
+int get_framebuffer(const char *dri_device, const char *connector_name, const char *topology_path,
+		    const char *lease_socket, struct framebuffer *fb);
+/* Restores the CRTC as it was before get_framebuffer() and frees everything */
+void release_framebuffer(struct framebuffer *fb);
+
+int show_framebuffer(struct framebuffer *fb);
+int scanout_framebuffer(struct framebuffer *fb, uint32_t buffer_id, uint16_t x, uint16_t y);
+void wait_for_termination(void);
+
+/* Set once SIGTERM or SIGINT arrived after catch_termination() */
+extern volatile sig_atomic_t terminate;
+void catch_termination(void);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Cache for producers which send the same frames again and again, e.g. a set of dashboard pages.
+ * A frame which is still in the cache is shown by scanning out its buffer, so it isn't copied
+ * again. Entries are evicted least recently used first. The budget limits the memory used for
+ * scanout buffers, which is scarce on devices with CMA.
+ *
+ * Frames are identified by a 64 bit hash only, the pixels are not compared. Reading back from
+ * write-combined scanout memory would cost more than copying the frame.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "fcache.h"
+
+#define FRAME_CACHE_MAX_ENTRIES 64
+
+#define HASH_PRIME_1 0x9e3779b185ebca87ULL
+#define HASH_PRIME_2 0xc2b2ae3d27d4eb4fULL
+
+static inline uint64_t rotl64(uint64_t v, int shift)
+{
+	return (v << shift) | (v >> (64 - shift));
+}
+
+static inline uint64_t hash_round(uint64_t h, uint64_t v)
+{
+	return rotl64(h + v * HASH_PRIME_2, 31) * HASH_PRIME_1;
+}
+
+/* Four independent lanes so the multiplications don't wait on each other */
+uint64_t hash_frame(const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	uint64_t h[4] = { HASH_PRIME_1, HASH_PRIME_2, 0, -HASH_PRIME_1 };
+	uint64_t v[4];
+	size_t i = 0;
+
+	for (; i + 32 <= size; i += 32) {
+		memcpy(v, &p[i], 32);
+		h[0] = hash_round(h[0], v[0]);
+		h[1] = hash_round(h[1], v[1]);
+		h[2] = hash_round(h[2], v[2]);
+		h[3] = hash_round(h[3], v[3]);
+	}
+
+	uint64_t hash = rotl64(h[0], 1) + rotl64(h[1], 7) + rotl64(h[2], 12) + rotl64(h[3], 18);
+
+	for (; i < size; i++)
+		hash = hash_round(hash, p[i]);
+
+	hash ^= size;
+	hash ^= hash >> 33;
+	hash *= HASH_PRIME_2;
+	hash ^= hash >> 29;
+
+	return hash;
+}
+
+int frame_cache_init(struct frame_cache *cache, int fd, uint32_t width, uint32_t height,
+		     uint64_t budget)
+{
+	uint64_t frame_size = (uint64_t)width * height * 4;
+
+	memset(cache, 0, sizeof(*cache));
+	cache->fd = fd;
+	cache->width = width;
+	cache->height = height;
+
+	cache->count = budget / frame_size;
+	if (cache->count > FRAME_CACHE_MAX_ENTRIES)
+		cache->count = FRAME_CACHE_MAX_ENTRIES;
+	/* The shown frame can't be evicted, so a single entry would never be reused */
+	if (cache->count < 2) {
+		printf("Frame cache budget too small for two frames\n");
+		cache->count = 0;
+		return -EINVAL;
+	}
+
+	cache->entries = calloc(cache->count, sizeof(*cache->entries));
+	if (!cache->entries) {
+		cache->count = 0;
+		return -ENOMEM;
+	}
+
+	print_verbose("Frame cache with %u entries\n", cache->count);
+
+	return 0;
+}
+
+void frame_cache_release(struct frame_cache *cache)
+{
+	if (cache->lookups)
+		printf("Frame cache: %lu of %lu frames hit (%.1f%%), %.1f MiB not copied\n",
+		       (unsigned long)cache->hits, (unsigned long)cache->lookups,
+		       100.0 * cache->hits / cache->lookups, cache->bytes_saved / (1024.0 * 1024.0));
+
+	for (uint32_t i = 0; i < cache->count; i++)
+		destroy_dumb_buffer(cache->fd, &cache->entries[i].buf);
+	free(cache->entries);
+	memset(cache, 0, sizeof(*cache));
+}
+
+struct dumb_buffer *frame_cache_lookup(struct frame_cache *cache, uint64_t hash)
+{
+	cache->lookups++;
+
+	for (uint32_t i = 0; i < cache->count; i++) {
+		struct frame_cache_entry *entry = &cache->entries[i];
+
+		if (entry->buf.data && entry->hash == hash) {
+			entry->last_used = ++cache->tick;
+			cache->hits++;
+			cache->bytes_saved += (uint64_t)cache->width * cache->height * 4;
+			return &entry->buf;
+		}
+	}
+
+	return 0;
+}
+
+/* Returns an empty or the least recently used buffer, the caller fills it with the frame */
+struct dumb_buffer *frame_cache_insert(struct frame_cache *cache, uint64_t hash)
+{
+	struct frame_cache_entry *victim = 0;
+
+	for (uint32_t i = 0; i < cache->count; i++) {
+		struct frame_cache_entry *entry = &cache->entries[i];
+
+		if (!entry->buf.data) {
+			victim = entry;
+			break;
+		}
+		if (!victim || entry->last_used < victim->last_used)
+			victim = entry;
+	}
+
+	if (!victim)
+		return 0;
+
+	if (!victim->buf.data && create_dumb_buffer(cache->fd, cache->width, cache->height,
+						     DRM_FORMAT_XRGB8888, &victim->buf))
+		return 0;
+
+	victim->hash = hash;
+	victim->last_used = ++cache->tick;
+
+	return &victim->buf;
+}
@@ -0,0 +1,53 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FCACHE_H
+#define FCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "buffer.h"
+
+struct frame_cache_entry {
+	uint64_t hash;
+	uint64_t last_used;
+	struct dumb_buffer buf;
+};
+
+/* Recently shown frames in scanout buffers, keyed by a hash of their content */
+struct frame_cache {
+	int fd;
+	uint32_t width;
+	uint32_t height;
+	uint32_t count;
+	struct frame_cache_entry *entries;
+	uint64_t tick;
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t bytes_saved;
+};
+
+int frame_cache_init(struct frame_cache *cache, int fd, uint32_t width, uint32_t height,
+		     uint64_t budget);
+void frame_cache_release(struct frame_cache *cache);
+
+struct dumb_buffer *frame_cache_lookup(struct frame_cache *cache, uint64_t hash);
+struct dumb_buffer *frame_cache_insert(struct frame_cache *cache, uint64_t hash);
+
+uint64_t hash_frame(const void *data, size_t size);
+
+#endif
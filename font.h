@@ -0,0 +1,52 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 8
+#define FONT_FIRST ' '
+#define FONT_LAST '~'
+#define FONT_MAX_SCALE 8
+
+/* Glyphs prerendered in XRGB8888 for one font scale and color pair */
+struct glyph_atlas {
+	uint32_t scale;
+	uint32_t fg;
+	uint32_t bg;
+	uint32_t cell_w;
+	uint32_t cell_h;
+	/* One block of cell_w * cell_h pixels per glyph */
+	uint32_t *pixels;
+};
+
+const struct glyph_atlas *get_glyph_atlas(uint32_t scale, uint32_t fg, uint32_t bg);
+void release_glyph_atlases(void);
+
+/* Row y of the glyph for character c, characters without a glyph are shown as '?' */
+static inline const uint32_t *atlas_glyph_row(const struct glyph_atlas *atlas, unsigned char c,
+					      uint32_t y)
+{
+	if (c < FONT_FIRST || c > FONT_LAST)
+		c = '?';
+
+	return &atlas->pixels[((c - FONT_FIRST) * atlas->cell_h + y) * atlas->cell_w];
+}
+
+#endif
@@ -0,0 +1,373 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Core of the framebuffer handling which is shared by the command line tool and libdrmfb: opening
+ * the device, finding the output, the scanout buffer and DRM master.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "drm_framebuffer.h"
+#include "resources.h"
+#include "topology.h"
+#include "lease.h"
+
+int verbose = 0;
+int quiet = 0;
+
+void release_framebuffer(struct framebuffer *fb)
+{
+	if (fb->fd) {
+		/* Try to become master again, else we can't set CRTC. Then the current master needs
+		 * to reset everything. */
+		drmSetMaster(fb->fd);
+		if (fb->crtc) {
+			/* Set back to orignal frame buffer */
+			drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, fb->crtc->buffer_id, 0, 0,
+				       &fb->connector->connector_id, 1, fb->resolution);
+			drmModeFreeCrtc(fb->crtc);
+		}
+		if (fb->buffer_id)
+			drmModeFreeFB(drmModeGetFB(fb->fd, fb->buffer_id));
+		/* This will also release resolution */
+		if (fb->connector) {
+			drmModeFreeConnector(fb->connector);
+			fb->resolution = 0;
+		}
+		if (fb->dumb_framebuffer.handle)
+			ioctl(fb->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &fb->dumb_framebuffer);
+		close(fb->fd);
+	}
+}
+
+/* Finds the connector, its preferred mode and the CRTC driving it */
+static int find_output(int fd, const char *connector_name, struct framebuffer *fb)
+{
+	int err;
+	int index;
+	struct drm_resources res;
+
+	/* Get the resources of the DRM device (connectors, encoders, etc.)*/
+	err = drm_resources_load(fd, &res);
+	if (err)
+		return err;
+
+	/* Search the connector provided as argument */
+	index = drm_resources_find_connector(&res, connector_name);
+	drmModeConnectorPtr connector = index < 0 ? 0 : drm_resources_take_connector(&res, index);
+	if (!connector) {
+		print_error("Could not find matching connector %s\n", connector_name);
+		err = -EINVAL;
+		goto cleanup;
+	}
+	fb->connector = connector;
+
+	/* Get the preferred resolution */
+	drmModeModeInfoPtr resolution = 0;
+	for (int i = 0; i < connector->count_modes; i++) {
+		drmModeModeInfoPtr mode = &connector->modes[i];
+		if (mode->type & DRM_MODE_TYPE_PREFERRED)
+			resolution = mode;
+	}
+
+	if (!resolution) {
+		print_error("Could not find preferred resolution\n");
+		err = -EINVAL;
+		goto cleanup;
+	}
+	fb->resolution = resolution;
+
+	/* Get the crtc settings */
+	fb->crtc = drm_resources_take_crtc(&res, drm_resources_find_crtc(&res, connector, 0));
+	if (!fb->crtc) {
+		print_error("Could not get crtc\n");
+		err = -EINVAL;
+		goto cleanup;
+	}
+	fb->crtc_index = drm_resources_crtc_index(&res, fb->crtc->crtc_id);
+
+cleanup:
+	/* We don't need the other objects anymore so let's free them */
+	drm_resources_release(&res);
+
+	return err;
+}
+
+int get_framebuffer(const char *dri_device, const char *connector_name, const char *topology_path,
+		    const char *lease_socket, struct framebuffer *fb)
+{
+	int err;
+	int fd;
+
+	/* Open the dri device /dev/dri/cardX, or get a lease of the connector */
+	if (lease_socket)
+		fd = lease_request(lease_socket, connector_name);
+	else
+		fd = open(dri_device, O_RDWR);
+	if (fd < 0) {
+		err = lease_socket ? fd : -errno;
+		print_error("Could not open dri device %s\n", dri_device);
+		return err;
+	}
+	/* Set early so that release_framebuffer() cleans up on errors */
+	fb->fd = fd;
+	/* A lessee is master of its lease for its whole lifetime */
+	fb->master = lease_socket != NULL;
+
+	if (!topology_path || topology_restore(topology_path, dri_device, connector_name, fb)) {
+		err = find_output(fd, connector_name, fb);
+		if (err)
+			goto cleanup;
+		if (topology_path)
+			topology_store(topology_path, dri_device, connector_name, fb);
+	}
+	drmModeModeInfoPtr resolution = fb->resolution;
+
+	/* The buffer may be larger than the mode, the CRTC then only scans out a part of it */
+	if (fb->virt_x < resolution->hdisplay)
+		fb->virt_x = resolution->hdisplay;
+	if (fb->virt_y < resolution->vdisplay)
+		fb->virt_y = resolution->vdisplay;
+
+	fb->dumb_framebuffer.height = fb->virt_y;
+	fb->dumb_framebuffer.width = fb->virt_x;
+	fb->dumb_framebuffer.bpp = 32;
+
+	err = ioctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &fb->dumb_framebuffer);
+	if (err) {
+		err = -errno;
+		print_error("Could not create dumb framebuffer (err=%d)\n", err);
+		goto cleanup;
+	}
+
+	err = drmModeAddFB(fd, fb->virt_x, fb->virt_y, 24, 32, fb->dumb_framebuffer.pitch,
+			   fb->dumb_framebuffer.handle, &fb->buffer_id);
+	if (err) {
+		print_error("Could not add framebuffer to drm (err=%d)\n", err);
+		goto cleanup;
+	}
+
+	struct drm_mode_map_dumb mreq;
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.handle = fb->dumb_framebuffer.handle;
+
+	err = drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq);
+	if (err) {
+		err = -errno;
+		print_error("Mode map dumb framebuffer failed (err=%d)\n", err);
+		goto cleanup;
+	}
+
+	fb->data = mmap(0, fb->dumb_framebuffer.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+			mreq.offset);
+	if (fb->data == MAP_FAILED) {
+		err = -errno;
+		print_error("Mode map failed (err=%d)\n", err);
+		goto cleanup;
+	}
+
+	/* Make sure we are not master anymore so that other processes can add new framebuffers as
+	 * well */
+	if (!fb->master)
+		drmDropMaster(fd);
+
+	fb->res_x = resolution->hdisplay;
+	fb->res_y = resolution->vdisplay;
+	fb->size = fb->dumb_framebuffer.size;
+
+cleanup:
+	if (err)
+		release_framebuffer(fb);
+
+	return err;
+}
+
+int hold_master = 0;
+
+/* Acquisition latency in powers of two microseconds, the first bucket is below 1 us */
+#define MASTER_BUCKETS 16
+
+static struct {
+	uint64_t acquired;
+	uint64_t failed;
+	double wait_total;
+	double wait_max;
+	uint64_t buckets[MASTER_BUCKETS];
+	uint64_t windows;
+	double held_total;
+	double held_max;
+	double since;
+} master_stats;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int master_acquire(struct framebuffer *fb)
+{
+	double start, wait;
+	int bucket = 0;
+	int ret;
+
+	if (fb->master)
+		return 0;
+
+	start = now();
+	ret = drmSetMaster(fb->fd);
+	wait = now() - start;
+
+	if (ret) {
+		ret = -errno;
+		master_stats.failed++;
+		print_error("Could not get master role for DRM.\n");
+		return ret;
+	}
+
+	master_stats.acquired++;
+	master_stats.wait_total += wait;
+	if (wait > master_stats.wait_max)
+		master_stats.wait_max = wait;
+	for (double us = wait * 1e6; us >= 1 && bucket < MASTER_BUCKETS - 1; us /= 2)
+		bucket++;
+	master_stats.buckets[bucket]++;
+
+	fb->master = hold_master;
+	master_stats.since = now();
+
+	return 0;
+}
+
+void master_release(struct framebuffer *fb)
+{
+	double held;
+
+	if (fb->master)
+		return;
+
+	drmDropMaster(fb->fd);
+
+	held = now() - master_stats.since;
+	master_stats.windows++;
+	master_stats.held_total += held;
+	if (held > master_stats.held_max)
+		master_stats.held_max = held;
+}
+
+void master_print_stats(void)
+{
+	if (!master_stats.acquired && !master_stats.failed)
+		return;
+
+	printf("DRM master: %lu acquisitions, %lu failed, %.1f us average, %.1f us max\n",
+	       (unsigned long)master_stats.acquired, (unsigned long)master_stats.failed,
+	       master_stats.acquired ? master_stats.wait_total * 1e6 / master_stats.acquired : 0,
+	       master_stats.wait_max * 1e6);
+	for (int i = 0; i < MASTER_BUCKETS; i++) {
+		if (!master_stats.buckets[i])
+			continue;
+		if (i == 0)
+			printf("  < 1 us: %lu\n", (unsigned long)master_stats.buckets[i]);
+		else if (i == MASTER_BUCKETS - 1)
+			printf("  >= %u us: %lu\n", 1u << (i - 1),
+			       (unsigned long)master_stats.buckets[i]);
+		else
+			printf("  %u-%u us: %lu\n", 1u << (i - 1), 1u << i,
+			       (unsigned long)master_stats.buckets[i]);
+	}
+	if (master_stats.windows)
+		printf("Held for %.1f us average, %.1f us max\n",
+		       master_stats.held_total * 1e6 / master_stats.windows,
+		       master_stats.held_max * 1e6);
+}
+
+int show_framebuffer(struct framebuffer *fb)
+{
+	int ret;
+
+	/* Make sure we synchronize the display with the buffer. This also works if page flips are
+	 * enabled */
+	ret = master_acquire(fb);
+	if (ret)
+		return ret;
+	drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, 0, 0, 0, NULL, 0, NULL);
+	drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, fb->buffer_id, fb->pan_x, fb->pan_y,
+		       &fb->connector->connector_id, 1, fb->resolution);
+	master_release(fb);
+
+	return 0;
+}
+
+/* Scan out any buffer of the same format without a full modeset, e.g. to pan over it */
+int scanout_framebuffer(struct framebuffer *fb, uint32_t buffer_id, uint16_t x, uint16_t y)
+{
+	int ret;
+
+	ret = master_acquire(fb);
+	if (ret)
+		return ret;
+	/* The mode doesn't change, so this doesn't cause a full modeset */
+	ret = drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, buffer_id, x, y,
+			     &fb->connector->connector_id, 1, fb->resolution);
+	master_release(fb);
+
+	return ret;
+}
+
+volatile sig_atomic_t terminate;
+
+static void handle_termination(int sig)
+{
+	terminate = 1;
+}
+
+/* Set terminate on SIGTERM/SIGINT instead of exiting, so the CRTC gets restored */
+void catch_termination(void)
+{
+	struct sigaction sa;
+
+	/* No SA_RESTART, a signal has to interrupt a blocking read */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_termination;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+}
+
+void wait_for_termination(void)
+{
+	sigset_t wait_set;
+	sigemptyset(&wait_set);
+	sigaddset(&wait_set, SIGTERM);
+	sigaddset(&wait_set, SIGINT);
+
+	int sig;
+	sigprocmask(SIG_BLOCK, &wait_set, NULL);
+	sigwait(&wait_set, &sig);
+}
@@ -0,0 +1,99 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * DRM hotplug events from the kernel uevent netlink socket. No udev is needed, the kernel sends
+ * "change" events with HOTPLUG=1 for the card and, since Linux 5.1, CONNECTOR=<id> for the
+ * connector which changed.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "drm_framebuffer.h"
+#include "hotplug.h"
+
+/* Multicast group of the kernel, udev sends its own copies to group 2 */
+#define UEVENT_KERNEL_GROUP 1
+
+int hotplug_open(void)
+{
+	struct sockaddr_nl addr;
+	int sock;
+
+	sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (sock < 0) {
+		printf("Could not open uevent socket (err=%d)\n", errno);
+		return -errno;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = UEVENT_KERNEL_GROUP;
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("Could not bind uevent socket (err=%d)\n", errno);
+		close(sock);
+		return -errno;
+	}
+
+	return sock;
+}
+
+/* Returns 1 for a DRM hotplug event, 0 for anything else and when nothing is queued */
+int hotplug_read(int sock, struct hotplug_event *event)
+{
+	char buf[4096];
+	struct sockaddr_nl addr;
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) - 1 };
+	struct msghdr msg = {
+		.msg_name = &addr,
+		.msg_namelen = sizeof(addr),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	int drm = 0, hotplug = 0;
+	ssize_t len;
+
+	len = recvmsg(sock, &msg, 0);
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+	buf[len] = '\0';
+
+	/* Only the kernel sends from port 0, anything else could be any local process */
+	if (msg.msg_namelen != sizeof(addr) || addr.nl_pid != 0)
+		return 0;
+
+	event->minor = -1;
+	event->connector_id = 0;
+
+	/* "ACTION@DEVPATH" followed by KEY=VALUE strings, all separated by NUL */
+	for (char *p = buf; p < buf + len; p += strlen(p) + 1) {
+		if (strcmp(p, "SUBSYSTEM=drm") == 0)
+			drm = 1;
+		else if (strcmp(p, "HOTPLUG=1") == 0)
+			hotplug = 1;
+		else if (strncmp(p, "MINOR=", 6) == 0)
+			event->minor = strtol(p + 6, NULL, 10);
+		else if (strncmp(p, "CONNECTOR=", 10) == 0)
+			event->connector_id = strtoul(p + 10, NULL, 10);
+	}
+
+	return drm && hotplug;
+}
@@ -0,0 +1,248 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Image files for the display. QOI images are decoded and placed on the display, anything else has
+ * to be a raw XRGB8888 image of the display size. Files are decoded in strips straight into the
+ * destination, see pipeline.c.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "drm_framebuffer.h"
+#include "qoi.h"
+#include "pipeline.h"
+#include "image.h"
+
+static uint8_t *read_file(FILE *file, size_t size)
+{
+	uint8_t *data;
+
+	data = malloc(size);
+	if (data && fread(data, 1, size, file) != size) {
+		free(data);
+		data = NULL;
+	}
+
+	return data;
+}
+
+struct qoi_source {
+	struct strip_source base;
+	struct qoi_decoder dec;
+};
+
+static void qoi_read_rows(struct strip_source *source, uint32_t *rows, uint32_t count)
+{
+	struct qoi_source *qoi = (struct qoi_source *)source;
+
+	qoi_decode_pixels(&qoi->dec, rows, (size_t)count * source->width);
+	source->bytes_read = qoi->dec.pos;
+}
+
+/* Decodes the QOI image in strips straight into dst */
+static int decode_image(struct framebuffer *fb, const uint8_t *data, size_t size, uint8_t *dst,
+			uint32_t pitch, enum image_scale scale, struct pipeline_stats *stats)
+{
+	struct qoi_source qoi;
+	struct pipeline p;
+	uint32_t width, height, w = fb->res_x, h = fb->res_y;
+	int err;
+
+	memset(&qoi, 0, sizeof(qoi));
+	err = qoi_decoder_init(&qoi.dec, data, size);
+	if (err)
+		return err;
+	width = qoi.base.width = qoi.dec.width;
+	height = qoi.base.height = qoi.dec.height;
+	qoi.base.read_rows = qoi_read_rows;
+
+	memset(&p, 0, sizeof(p));
+	p.source = &qoi.base;
+	p.dst = dst;
+	p.dst_pitch = pitch;
+	p.dst_width = fb->res_x;
+	p.dst_height = fb->res_y;
+
+	if (scale == IMAGE_CENTER || (width == w && height == h)) {
+		/* Original size, cut off at the display edges */
+		w = width < fb->res_x ? width : fb->res_x;
+		h = height < fb->res_y ? height : fb->res_y;
+		p.src_x = (width - w) / 2;
+		p.src_y = (height - h) / 2;
+		p.src_w = w;
+		p.src_h = h;
+	} else {
+		if (scale == IMAGE_FIT) {
+			if ((uint64_t)width * fb->res_y > (uint64_t)height * fb->res_x)
+				h = (uint64_t)height * fb->res_x / width;
+			else
+				w = (uint64_t)width * fb->res_y / height;
+			if (!w)
+				w = 1;
+			if (!h)
+				h = 1;
+		}
+		p.src_w = width;
+		p.src_h = height;
+	}
+	p.x = (fb->res_x - w) / 2;
+	p.y = (fb->res_y - h) / 2;
+	p.w = w;
+	p.h = h;
+
+	err = pipeline_run(&p);
+	*stats = p.stats;
+
+	return err;
+}
+
+/* Centers the image on the display, cutting off what doesn't fit */
+static void center_image(struct framebuffer *fb, uint32_t *dst, const uint32_t *src, uint32_t width,
+			 uint32_t height)
+{
+	uint32_t w = width < fb->res_x ? width : fb->res_x;
+	uint32_t h = height < fb->res_y ? height : fb->res_y;
+	uint32_t dst_x = (fb->res_x - w) / 2, dst_y = (fb->res_y - h) / 2;
+	uint32_t src_x = (width - w) / 2, src_y = (height - h) / 2;
+
+	if (w != fb->res_x || h != fb->res_y)
+		memset(dst, 0, (size_t)fb->res_x * fb->res_y * 4);
+
+	for (uint32_t y = 0; y < h; y++)
+		memcpy(&dst[(size_t)(dst_y + y) * fb->res_x + dst_x],
+		       &src[(size_t)(src_y + y) * width + src_x], w * 4);
+}
+
+/* Nearest neighbour scaling into a w x h area centered on the display */
+static void scale_image(struct framebuffer *fb, uint32_t *dst, const uint32_t *src, uint32_t width,
+			uint32_t height, uint32_t w, uint32_t h)
+{
+	uint32_t dst_x = (fb->res_x - w) / 2, dst_y = (fb->res_y - h) / 2;
+	uint64_t step_x = ((uint64_t)width << 16) / w, step_y = ((uint64_t)height << 16) / h;
+
+	if (w != fb->res_x || h != fb->res_y)
+		memset(dst, 0, (size_t)fb->res_x * fb->res_y * 4);
+
+	for (uint32_t y = 0; y < h; y++) {
+		const uint32_t *row = &src[(size_t)((y * step_y) >> 16) * width];
+		uint32_t *out = &dst[(size_t)(dst_y + y) * fb->res_x + dst_x];
+		uint64_t sx = 0;
+
+		for (uint32_t x = 0; x < w; x++, sx += step_x)
+			out[x] = row[sx >> 16];
+	}
+}
+
+void place_image(struct framebuffer *fb, uint32_t *dst, const uint32_t *src, uint32_t width,
+		 uint32_t height, enum image_scale scale)
+{
+	uint32_t w = fb->res_x, h = fb->res_y;
+
+	if (scale == IMAGE_CENTER || (width == w && height == h)) {
+		center_image(fb, dst, src, width, height);
+		return;
+	}
+
+	/* Keep the aspect ratio, the other side gets black bars */
+	if (scale == IMAGE_FIT) {
+		if ((uint64_t)width * fb->res_y > (uint64_t)height * fb->res_x)
+			h = (uint64_t)height * fb->res_x / width;
+		else
+			w = (uint64_t)width * fb->res_y / height;
+		if (!w)
+			w = 1;
+		if (!h)
+			h = 1;
+	}
+
+	scale_image(fb, dst, src, width, height, w, h);
+}
+
+int load_image_to(struct framebuffer *fb, const char *path, uint8_t *dst, uint32_t pitch,
+		  enum image_scale scale)
+{
+	size_t frame_size = (size_t)fb->res_x * fb->res_y * 4;
+	struct pipeline_stats stats;
+	struct stat st;
+	char magic[4];
+	uint8_t *data;
+	FILE *file;
+	int err = 0;
+
+	file = fopen(path, "rb");
+	if (!file)
+		return -EIO;
+
+	if (fstat(fileno(file), &st) || !S_ISREG(st.st_mode) || st.st_size < 4 ||
+	    fread(magic, 1, 4, file) != 4) {
+		fclose(file);
+		return -EIO;
+	}
+	rewind(file);
+
+	memset(&stats, 0, sizeof(stats));
+	if (memcmp(magic, "qoif", 4) == 0) {
+		data = read_file(file, st.st_size);
+		if (!data) {
+			err = -EIO;
+			goto cleanup;
+		}
+		err = decode_image(fb, data, st.st_size, dst, pitch, scale, &stats);
+		free(data);
+		if (err) {
+			printf("Could not decode %s\n", path);
+			goto cleanup;
+		}
+	} else if ((size_t)st.st_size == frame_size) {
+		/* Raw images are read row by row into place */
+		for (uint32_t y = 0; y < fb->res_y; y++) {
+			if (fread(&dst[(size_t)y * pitch], 1, fb->res_x * 4, file) != fb->res_x * 4u) {
+				err = -EIO;
+				goto cleanup;
+			}
+		}
+		stats.bytes_written = frame_size;
+	} else {
+		print_verbose("%s is neither QOI nor a %ux%u raw image\n", path, fb->res_x,
+			      fb->res_y);
+		err = -EINVAL;
+		goto cleanup;
+	}
+
+	print_verbose("Loaded %s, %llu KiB read, %llu KiB written\n", path,
+		      (unsigned long long)(stats.bytes_read + st.st_size) >> 10,
+		      (unsigned long long)stats.bytes_written >> 10);
+
+cleanup:
+	fclose(file);
+
+	return err;
+}
+
+int load_image_scaled(struct framebuffer *fb, const char *path, uint32_t *dst,
+		      enum image_scale scale)
+{
+	return load_image_to(fb, path, (uint8_t *)dst, fb->res_x * 4, scale);
+}
+
+int load_image(struct framebuffer *fb, const char *path, uint32_t *dst)
+{
+	return load_image_scaled(fb, path, dst, IMAGE_CENTER);
+}
@@ -0,0 +1,44 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+
+#include "drm_framebuffer.h"
+
+enum image_scale {
+	/* Original size, cut off at the display edges */
+	IMAGE_CENTER,
+	/* Stretched to the whole display */
+	IMAGE_STRETCH,
+	/* As large as possible with the aspect ratio kept */
+	IMAGE_FIT,
+};
+
+/* Puts a width x height image into dst, which holds res_x * res_y pixels without padding */
+void place_image(struct framebuffer *fb, uint32_t *dst, const uint32_t *src, uint32_t width,
+		 uint32_t height, enum image_scale scale);
+
+/* Loads a QOI or raw image file into dst, which has rows of pitch bytes, e.g. a scanout buffer */
+int load_image_to(struct framebuffer *fb, const char *path, uint8_t *dst, uint32_t pitch,
+		  enum image_scale scale);
+/* Loads a QOI or raw image file into dst */
+int load_image(struct framebuffer *fb, const char *path, uint32_t *dst);
+int load_image_scaled(struct framebuffer *fb, const char *path, uint32_t *dst,
+		      enum image_scale scale);
+
+#endif
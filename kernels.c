@@ -0,0 +1,279 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Kernel registry: the scalar kernels and the selection of the SIMD ones at startup. The SIMD
+ * kernels are compiled with target attributes, so no special compiler flags are needed and the
+ * CPU is only asked at runtime.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "drm_framebuffer.h"
+#include "fcache.h"
+#include "kernels.h"
+
+static void copy_scalar(void *dst, const void *src, size_t size)
+{
+	memcpy(dst, src, size);
+}
+
+static void convert_scalar(uint16_t *dst, const uint32_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] = (src[i] >> 8 & 0xf800) | (src[i] >> 5 & 0x07e0) | (src[i] >> 3 & 0x001f);
+}
+
+static void fill_scalar(uint32_t *dst, uint32_t color, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] = color;
+}
+
+static void blend_scalar(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		uint32_t s = src[i];
+		uint32_t a = s >> 24;
+		uint32_t inv, rb, ag;
+
+		if (a == 0xff) {
+			dst[i] = s;
+			continue;
+		}
+		if (a == 0)
+			continue;
+
+		inv = 0xff - a;
+		rb = (dst[i] & 0x00ff00ff) * inv;
+		ag = ((dst[i] >> 8) & 0x00ff00ff) * inv;
+		rb = ((rb + ((rb >> 8) & 0x00ff00ff) + 0x00800080) >> 8) & 0x00ff00ff;
+		ag = (ag + ((ag >> 8) & 0x00ff00ff) + 0x00800080) & 0xff00ff00;
+		dst[i] = s + (rb | ag);
+	}
+}
+
+/* Red and blue, then alpha and green share one multiply */
+static void crossfade_scalar(uint32_t *dst, const uint32_t *a, const uint32_t *b, size_t count,
+			     uint32_t weight)
+{
+	for (size_t i = 0; i < count; i++) {
+		uint32_t rb = (a[i] & 0xff00ff) * (256 - weight) + (b[i] & 0xff00ff) * weight;
+		uint32_t ag = (a[i] >> 8 & 0xff00ff) * (256 - weight) + (b[i] >> 8 & 0xff00ff) * weight;
+
+		dst[i] = (rb >> 8 & 0xff00ff) | (ag & 0xff00ff00);
+	}
+}
+
+static int scalar_supported(void)
+{
+	return 1;
+}
+
+const struct kernel_set kernels_scalar = {
+	.name = "scalar",
+	.supported = scalar_supported,
+	.ops = {
+		.copy = copy_scalar,
+		.convert = convert_scalar,
+		.fill = fill_scalar,
+		.blend = blend_scalar,
+		.crossfade = crossfade_scalar,
+		.hash = hash_frame,
+	},
+};
+
+/* From the lowest to the highest level */
+static const struct kernel_set *const kernel_sets[] = {
+	&kernels_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+	&kernels_sse2,
+	&kernels_avx2,
+	&kernels_avx512,
+#endif
+#ifdef __aarch64__
+	&kernels_neon,
+#endif
+};
+
+/* Usable before kernels_init() */
+struct kernels kernels = {
+	.copy = copy_scalar,
+	.convert = convert_scalar,
+	.fill = fill_scalar,
+	.blend = blend_scalar,
+	.crossfade = crossfade_scalar,
+	.hash = hash_frame,
+};
+
+/* Level each operation was taken from */
+static struct {
+	const char *copy, *convert, *fill, *blend, *crossfade, *hash;
+} kernel_names = { "scalar", "scalar", "scalar", "scalar", "scalar", "scalar" };
+
+#define BIND(set, op)                                  \
+	do {                                           \
+		if ((set)->ops.op) {                   \
+			kernels.op = (set)->ops.op;    \
+			kernel_names.op = (set)->name; \
+		}                                      \
+	} while (0)
+
+int kernels_init(const char *limit)
+{
+	size_t i;
+
+	if (limit) {
+		for (i = 0; i < ARRAY_SIZE(kernel_sets); i++) {
+			if (strcmp(kernel_sets[i]->name, limit) == 0)
+				break;
+		}
+		if (i == ARRAY_SIZE(kernel_sets)) {
+			printf("Unknown kernel level %s\n", limit);
+			return -EINVAL;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(kernel_sets); i++) {
+		const struct kernel_set *set = kernel_sets[i];
+
+		if (!set->supported())
+			continue;
+		BIND(set, copy);
+		BIND(set, convert);
+		BIND(set, fill);
+		BIND(set, blend);
+		BIND(set, crossfade);
+		BIND(set, hash);
+		if (limit && strcmp(set->name, limit) == 0)
+			break;
+	}
+
+	return 0;
+}
+
+void kernels_print(void)
+{
+	printf("Kernels: copy %s, convert %s, fill %s, blend %s, crossfade %s, hash %s\n",
+	       kernel_names.copy, kernel_names.convert, kernel_names.fill, kernel_names.blend,
+	       kernel_names.crossfade, kernel_names.hash);
+}
+
+/* Sizes and offsets which hit the vector bodies, the tails and unaligned starts */
+static const size_t check_sizes[] = { 0, 1, 3, 7, 8, 15, 16, 17, 31, 33, 63, 64, 65, 255, 1920 };
+/* Both ends of the crossfade and some steps in between */
+static const uint32_t check_weights[] = { 0, 1, 127, 128, 255, 256 };
+
+static int check_set(const struct kernel_set *set, uint32_t *a, uint32_t *b, uint32_t *src,
+		     size_t n)
+{
+	const struct kernels *ref = &kernels_scalar.ops;
+	const struct kernels *k = &set->ops;
+	int errors = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(check_sizes); i++) {
+		for (size_t off = 0; off < 4; off++) {
+			size_t count = check_sizes[i];
+			uint32_t *s = src + off;
+
+			if (k->copy) {
+				memset(a, 0, n * 4);
+				memset(b, 0, n * 4);
+				ref->copy((uint8_t *)a + off, s, count * 4 + off);
+				k->copy((uint8_t *)b + off, s, count * 4 + off);
+				errors += memcmp(a, b, n * 4) != 0;
+			}
+			if (k->convert) {
+				memset(a, 0, n * 4);
+				memset(b, 0, n * 4);
+				ref->convert((uint16_t *)a + off, s, count);
+				k->convert((uint16_t *)b + off, s, count);
+				errors += memcmp(a, b, n * 4) != 0;
+			}
+			if (k->fill) {
+				memset(a, 0, n * 4);
+				memset(b, 0, n * 4);
+				ref->fill(a + off, s[0], count);
+				k->fill(b + off, s[0], count);
+				errors += memcmp(a, b, n * 4) != 0;
+			}
+			if (k->blend) {
+				memcpy(a, src + n / 2, n * 2);
+				memcpy(b, src + n / 2, n * 2);
+				ref->blend(a + off, s, count);
+				k->blend(b + off, s, count);
+				errors += memcmp(a, b, n * 2) != 0;
+			}
+			for (size_t w = 0; k->crossfade && w < ARRAY_SIZE(check_weights); w++) {
+				memset(a, 0, n * 4);
+				memset(b, 0, n * 4);
+				ref->crossfade(a + off, s, src + n / 2, count, check_weights[w]);
+				k->crossfade(b + off, s, src + n / 2, count, check_weights[w]);
+				errors += memcmp(a, b, n * 4) != 0;
+			}
+			if (k->hash)
+				errors += ref->hash((uint8_t *)s + off, count * 4 + off) !=
+					  k->hash((uint8_t *)s + off, count * 4 + off);
+		}
+	}
+
+	return errors;
+}
+
+int kernels_check(void)
+{
+	size_t n = 4096;
+	uint32_t *a = malloc(n * 4), *b = malloc(n * 4), *src = malloc(n * 4);
+	uint32_t seed = 1;
+	int errors = 0;
+
+	if (!a || !b || !src) {
+		errors = 1;
+		goto cleanup;
+	}
+
+	/* Random pixels with a good share of fully opaque and fully transparent ones */
+	for (size_t i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		src[i] = seed;
+		if (i % 5 == 0)
+			src[i] |= 0xff000000;
+		else if (i % 5 == 1)
+			src[i] &= 0x00ffffff;
+	}
+
+	for (size_t i = 1; i < ARRAY_SIZE(kernel_sets); i++) {
+		const struct kernel_set *set = kernel_sets[i];
+		int set_errors;
+
+		if (!set->supported()) {
+			printf("%s: not supported\n", set->name);
+			continue;
+		}
+		set_errors = check_set(set, a, b, src, n);
+		printf("%s: %s\n", set->name, set_errors ? "MISMATCH" : "ok");
+		errors += set_errors;
+	}
+
+cleanup:
+	free(a);
+	free(b);
+	free(src);
+
+	return errors;
+}
@@ -0,0 +1,66 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * The pixel loops which move most of the bytes. kernels_init() binds the best implementation the
+ * CPU supports, the same binary runs on x86 with SSE2, AVX2 or AVX-512 and on aarch64 with NEON.
+ * Every implementation gives the same results as the scalar one.
+ */
+struct kernels {
+	void (*copy)(void *dst, const void *src, size_t size);
+	/* XRGB8888 to RGB565 */
+	void (*convert)(uint16_t *dst, const uint32_t *src, size_t count);
+	void (*fill)(uint32_t *dst, uint32_t color, size_t count);
+	/* dst = src + dst * (1 - src_alpha) for premultiplied src */
+	void (*blend)(uint32_t *dst, const uint32_t *src, size_t count);
+	/* dst = (a * (256 - weight) + b * weight) / 256 for every channel, weight is 0 to 256 */
+	void (*crossfade)(uint32_t *dst, const uint32_t *a, const uint32_t *b, size_t count,
+			  uint32_t weight);
+	/* hash_frame(), the value is stored on disk and must never change */
+	uint64_t (*hash)(const void *data, size_t size);
+};
+
+/* One implementation level, operations it doesn't improve on are NULL */
+struct kernel_set {
+	const char *name;
+	int (*supported)(void);
+	struct kernels ops;
+};
+
+extern struct kernels kernels;
+
+/* Binds the best supported kernels, up to the level named limit if it isn't NULL */
+int kernels_init(const char *limit);
+void kernels_print(void);
+/* Compares every supported implementation with the scalar one, returns the number of mismatches */
+int kernels_check(void);
+
+extern const struct kernel_set kernels_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+extern const struct kernel_set kernels_sse2;
+extern const struct kernel_set kernels_avx2;
+extern const struct kernel_set kernels_avx512;
+#endif
+#ifdef __aarch64__
+extern const struct kernel_set kernels_neon;
+#endif
+
+#endif
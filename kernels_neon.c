@@ -0,0 +1,155 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * NEON kernels for aarch64, where NEON is part of the base architecture. The hardware capabilities
+ * are still asked, so a kernel which hides them can't break the display.
+ */
+
+#include "kernels.h"
+
+#ifdef __aarch64__
+
+#include <string.h>
+#include <sys/auxv.h>
+#include <arm_neon.h>
+
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)
+#endif
+
+static int neon_supported(void)
+{
+	return !!(getauxval(AT_HWCAP) & HWCAP_ASIMD);
+}
+
+static void copy_neon(void *dst, const void *src, size_t size)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+	for (; i + 64 <= size; i += 64) {
+		uint8x16_t a = vld1q_u8(&s[i]);
+		uint8x16_t b = vld1q_u8(&s[i + 16]);
+		uint8x16_t c = vld1q_u8(&s[i + 32]);
+		uint8x16_t e = vld1q_u8(&s[i + 48]);
+
+		vst1q_u8(&d[i], a);
+		vst1q_u8(&d[i + 16], b);
+		vst1q_u8(&d[i + 32], c);
+		vst1q_u8(&d[i + 48], e);
+	}
+	memcpy(&d[i], &s[i], size - i);
+}
+
+static uint16x4_t rgb565_neon(uint32x4_t x)
+{
+	uint32x4_t v = vorrq_u32(
+		vorrq_u32(vandq_u32(vshrq_n_u32(x, 8), vdupq_n_u32(0xf800)),
+			  vandq_u32(vshrq_n_u32(x, 5), vdupq_n_u32(0x07e0))),
+		vandq_u32(vshrq_n_u32(x, 3), vdupq_n_u32(0x001f)));
+
+	return vmovn_u32(v);
+}
+
+static void convert_neon(uint16_t *dst, const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		vst1q_u16(&dst[i], vcombine_u16(rgb565_neon(vld1q_u32(&src[i])),
+						rgb565_neon(vld1q_u32(&src[i + 4]))));
+	kernels_scalar.ops.convert(&dst[i], &src[i], count - i);
+}
+
+static void fill_neon(uint32_t *dst, uint32_t color, size_t count)
+{
+	uint32x4_t v = vdupq_n_u32(color);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		vst1q_u32(&dst[i], v);
+	kernels_scalar.ops.fill(&dst[i], color, count - i);
+}
+
+/* (t + (t >> 8) + 0x80) >> 8 like the scalar kernel, t = channel * (255 - alpha) */
+static uint8x8_t scale_neon(uint8x8_t c, uint8x8_t inv)
+{
+	uint16x8_t t = vmull_u8(c, inv);
+
+	t = vaddq_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), vdupq_n_u16(0x80));
+	return vshrn_n_u16(t, 8);
+}
+
+static void blend_neon(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		uint32x4_t s = vld1q_u32(&src[i]);
+		uint32x4_t d = vld1q_u32(&dst[i]);
+		uint32x4_t alpha = vshrq_n_u32(s, 24);
+		/* 255 - alpha in all four bytes of each pixel */
+		uint8x16_t inv = vreinterpretq_u8_u32(
+			vmulq_n_u32(vsubq_u32(vdupq_n_u32(0xff), alpha), 0x01010101));
+		uint8x16_t d8 = vreinterpretq_u8_u32(d);
+		uint8x16_t r8 = vcombine_u8(scale_neon(vget_low_u8(d8), vget_low_u8(inv)),
+					    scale_neon(vget_high_u8(d8), vget_high_u8(inv)));
+		uint32x4_t r = vaddq_u32(s, vreinterpretq_u32_u8(r8));
+
+		/* Fully transparent pixels leave dst alone */
+		r = vbslq_u32(vceqq_u32(alpha, vdupq_n_u32(0)), d, r);
+		vst1q_u32(&dst[i], r);
+	}
+	kernels_scalar.ops.blend(&dst[i], &src[i], count - i);
+}
+
+/* a * (256 - weight) + b * weight fits into 16 bits, so the lanes can't overflow */
+static void crossfade_neon(uint32_t *dst, const uint32_t *a, const uint32_t *b, size_t count,
+			   uint32_t weight)
+{
+	const uint16x8_t wa = vdupq_n_u16(256 - weight);
+	const uint16x8_t wb = vdupq_n_u16(weight);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		uint8x16_t va = vreinterpretq_u8_u32(vld1q_u32(&a[i]));
+		uint8x16_t vb = vreinterpretq_u8_u32(vld1q_u32(&b[i]));
+		uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(va)), wa),
+					  vmovl_u8(vget_low_u8(vb)), wb);
+		uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(va)), wa),
+					  vmovl_u8(vget_high_u8(vb)), wb);
+
+		vst1q_u32(&dst[i], vreinterpretq_u32_u8(vcombine_u8(vshrn_n_u16(lo, 8),
+								      vshrn_n_u16(hi, 8))));
+	}
+	kernels_scalar.ops.crossfade(&dst[i], &a[i], &b[i], count - i, weight);
+}
+
+const struct kernel_set kernels_neon = {
+	.name = "neon",
+	.supported = neon_supported,
+	.ops = {
+		.copy = copy_neon,
+		.convert = convert_neon,
+		.fill = fill_neon,
+		.blend = blend_neon,
+		.crossfade = crossfade_neon,
+		/* The scalar hash keeps its four lanes in parallel, a vector doesn't beat it */
+	},
+};
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SSE2, AVX2 and AVX-512 kernels. Each function is compiled for its instruction set with a target
+ * attribute and only called after kernels_init() found the CPU supports it. Tails go to the
+ * scalar kernels, so the results are the same bit for bit.
+ *
+ * There is no SIMD hash: the four lanes of hash_frame() are one dependency chain in a vector
+ * register, and without a fast 64 bit multiplication that is slower than the scalar code which
+ * runs the lanes in parallel.
+ */
+
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <string.h>
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f,avx512bw,avx512dq,avx512vl")))
+
+/* SSE2 */
+
+static SSE2 int sse2_supported(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static SSE2 void copy_sse2(void *dst, const void *src, size_t size)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+	for (; i + 64 <= size; i += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&s[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&s[i + 16]);
+		__m128i c = _mm_loadu_si128((const __m128i *)&s[i + 32]);
+		__m128i e = _mm_loadu_si128((const __m128i *)&s[i + 48]);
+
+		_mm_storeu_si128((__m128i *)&d[i], a);
+		_mm_storeu_si128((__m128i *)&d[i + 16], b);
+		_mm_storeu_si128((__m128i *)&d[i + 32], c);
+		_mm_storeu_si128((__m128i *)&d[i + 48], e);
+	}
+	memcpy(&d[i], &s[i], size - i);
+}
+
+static SSE2 __m128i rgb565_sse2(__m128i x)
+{
+	return _mm_or_si128(
+		_mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0xf800)),
+			     _mm_and_si128(_mm_srli_epi32(x, 5), _mm_set1_epi32(0x07e0))),
+		_mm_and_si128(_mm_srli_epi32(x, 3), _mm_set1_epi32(0x001f)));
+}
+
+static SSE2 void convert_sse2(uint16_t *dst, const uint32_t *src, size_t count)
+{
+	/* packs saturates signed values, so shift the range there and back */
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = rgb565_sse2(_mm_loadu_si128((const __m128i *)&src[i]));
+		__m128i b = rgb565_sse2(_mm_loadu_si128((const __m128i *)&src[i + 4]));
+		__m128i v = _mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32));
+
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_xor_si128(v, bias16));
+	}
+	kernels_scalar.ops.convert(&dst[i], &src[i], count - i);
+}
+
+static SSE2 void fill_sse2(uint32_t *dst, uint32_t color, size_t count)
+{
+	__m128i v = _mm_set1_epi32(color);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)&dst[i], v);
+	kernels_scalar.ops.fill(&dst[i], color, count - i);
+}
+
+/* (t + (t >> 8) + 0x80) >> 8 like the scalar kernel, t = channel * (255 - alpha) */
+static SSE2 __m128i scale_sse2(__m128i c, __m128i inv)
+{
+	__m128i t = _mm_mullo_epi16(c, inv);
+
+	t = _mm_add_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), _mm_set1_epi16(0x80));
+	return _mm_srli_epi16(t, 8);
+}
+
+static SSE2 void blend_sse2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i d = _mm_loadu_si128((const __m128i *)&dst[i]);
+		__m128i inv = _mm_sub_epi32(_mm_set1_epi32(0xff), _mm_srli_epi32(s, 24));
+		__m128i lo, hi, r, transparent;
+
+		/* 255 - alpha in all four 16 bit channels of each pixel */
+		inv = _mm_or_si128(inv, _mm_slli_epi32(inv, 16));
+		lo = scale_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(inv, inv));
+		hi = scale_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(inv, inv));
+		r = _mm_add_epi32(s, _mm_packus_epi16(lo, hi));
+
+		/* Fully transparent pixels leave dst alone */
+		transparent = _mm_cmpeq_epi32(_mm_srli_epi32(s, 24), zero);
+		r = _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, r));
+		_mm_storeu_si128((__m128i *)&dst[i], r);
+	}
+	kernels_scalar.ops.blend(&dst[i], &src[i], count - i);
+}
+
+/* a * (256 - weight) + b * weight fits into 16 bits, so the lanes can't overflow */
+static SSE2 void crossfade_sse2(uint32_t *dst, const uint32_t *a, const uint32_t *b, size_t count,
+				uint32_t weight)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wa = _mm_set1_epi16(256 - weight);
+	const __m128i wb = _mm_set1_epi16(weight);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i va = _mm_loadu_si128((const __m128i *)&a[i]);
+		__m128i vb = _mm_loadu_si128((const __m128i *)&b[i]);
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+					   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+					   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+
+		_mm_storeu_si128((__m128i *)&dst[i],
+				 _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	kernels_scalar.ops.crossfade(&dst[i], &a[i], &b[i], count - i, weight);
+}
+
+const struct kernel_set kernels_sse2 = {
+	.name = "sse2",
+	.supported = sse2_supported,
+	.ops = {
+		.copy = copy_sse2,
+		.convert = convert_sse2,
+		.fill = fill_sse2,
+		.blend = blend_sse2,
+		.crossfade = crossfade_sse2,
+	},
+};
+
+/* AVX2 */
+
+static int avx2_supported(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static AVX2 void copy_avx2(void *dst, const void *src, size_t size)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+	for (; i + 128 <= size; i += 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)&s[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i *)&s[i + 32]);
+		__m256i c = _mm256_loadu_si256((const __m256i *)&s[i + 64]);
+		__m256i e = _mm256_loadu_si256((const __m256i *)&s[i + 96]);
+
+		_mm256_storeu_si256((__m256i *)&d[i], a);
+		_mm256_storeu_si256((__m256i *)&d[i + 32], b);
+		_mm256_storeu_si256((__m256i *)&d[i + 64], c);
+		_mm256_storeu_si256((__m256i *)&d[i + 96], e);
+	}
+	memcpy(&d[i], &s[i], size - i);
+}
+
+static AVX2 __m256i rgb565_avx2(__m256i x)
+{
+	return _mm256_or_si256(
+		_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 8), _mm256_set1_epi32(0xf800)),
+				_mm256_and_si256(_mm256_srli_epi32(x, 5), _mm256_set1_epi32(0x07e0))),
+		_mm256_and_si256(_mm256_srli_epi32(x, 3), _mm256_set1_epi32(0x001f)));
+}
+
+static AVX2 void convert_avx2(uint16_t *dst, const uint32_t *src, size_t count)
+{
+	const __m256i bias32 = _mm256_set1_epi32(0x8000);
+	const __m256i bias16 = _mm256_set1_epi16((short)0x8000);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256i a = rgb565_avx2(_mm256_loadu_si256((const __m256i *)&src[i]));
+		__m256i b = rgb565_avx2(_mm256_loadu_si256((const __m256i *)&src[i + 8]));
+		__m256i v = _mm256_packs_epi32(_mm256_sub_epi32(a, bias32),
+					       _mm256_sub_epi32(b, bias32));
+
+		/* packs works per 128 bit lane, put the quarters back in order */
+		v = _mm256_permute4x64_epi64(v, 0xd8);
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm256_xor_si256(v, bias16));
+	}
+	kernels_scalar.ops.convert(&dst[i], &src[i], count - i);
+}
+
+static AVX2 void fill_avx2(uint32_t *dst, uint32_t color, size_t count)
+{
+	__m256i v = _mm256_set1_epi32(color);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)&dst[i], v);
+	kernels_scalar.ops.fill(&dst[i], color, count - i);
+}
+
+static AVX2 __m256i scale_avx2(__m256i c, __m256i inv)
+{
+	__m256i t = _mm256_mullo_epi16(c, inv);
+
+	t = _mm256_add_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)),
+			     _mm256_set1_epi16(0x80));
+	return _mm256_srli_epi16(t, 8);
+}
+
+static AVX2 void blend_avx2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m256i d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+		__m256i inv = _mm256_sub_epi32(_mm256_set1_epi32(0xff), _mm256_srli_epi32(s, 24));
+		__m256i lo, hi, r, transparent;
+
+		inv = _mm256_or_si256(inv, _mm256_slli_epi32(inv, 16));
+		lo = scale_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(inv, inv));
+		hi = scale_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(inv, inv));
+		r = _mm256_add_epi32(s, _mm256_packus_epi16(lo, hi));
+
+		transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(s, 24), zero);
+		r = _mm256_blendv_epi8(r, d, transparent);
+		_mm256_storeu_si256((__m256i *)&dst[i], r);
+	}
+	kernels_scalar.ops.blend(&dst[i], &src[i], count - i);
+}
+
+static AVX2 void crossfade_avx2(uint32_t *dst, const uint32_t *a, const uint32_t *b, size_t count,
+				uint32_t weight)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i wa = _mm256_set1_epi16(256 - weight);
+	const __m256i wb = _mm256_set1_epi16(weight);
+	size_t i = 0;
+
+	/* unpack and pack both work per 128 bit lane, so the pixels stay in order */
+	for (; i + 8 <= count; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)&a[i]);
+		__m256i vb = _mm256_loadu_si256((const __m256i *)&b[i]);
+		__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+					      _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb));
+		__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+					      _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb));
+
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm256_packus_epi16(_mm256_srli_epi16(lo, 8),
+									      _mm256_srli_epi16(hi, 8)));
+	}
+	kernels_scalar.ops.crossfade(&dst[i], &a[i], &b[i], count - i, weight);
+}
+
+const struct kernel_set kernels_avx2 = {
+	.name = "avx2",
+	.supported = avx2_supported,
+	.ops = {
+		.copy = copy_avx2,
+		.convert = convert_avx2,
+		.fill = fill_avx2,
+		.blend = blend_avx2,
+		.crossfade = crossfade_avx2,
+	},
+};
+
+/* AVX-512 */
+
+static int avx512_supported(void)
+{
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+	       __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl");
+}
+
+static AVX512 void copy_avx512(void *dst, const void *src, size_t size)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+	for (; i + 128 <= size; i += 128) {
+		__m512i a = _mm512_loadu_si512(&s[i]);
+		__m512i b = _mm512_loadu_si512(&s[i + 64]);
+
+		_mm512_storeu_si512(&d[i], a);
+		_mm512_storeu_si512(&d[i + 64], b);
+	}
+	/* Masked moves for the rest instead of a byte loop */
+	for (; i < size; i += 64) {
+		__mmask64 mask = size - i >= 64 ? ~0ULL : (1ULL << (size - i)) - 1;
+
+		_mm512_mask_storeu_epi8(&d[i], mask, _mm512_maskz_loadu_epi8(mask, &s[i]));
+	}
+}
+
+static AVX512 void convert_avx512(uint16_t *dst, const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m512i x = _mm512_loadu_si512(&src[i]);
+		__m512i v = _mm512_or_si512(
+			_mm512_or_si512(
+				_mm512_and_si512(_mm512_srli_epi32(x, 8), _mm512_set1_epi32(0xf800)),
+				_mm512_and_si512(_mm512_srli_epi32(x, 5), _mm512_set1_epi32(0x07e0))),
+			_mm512_and_si512(_mm512_srli_epi32(x, 3), _mm512_set1_epi32(0x001f)));
+
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm512_cvtepi32_epi16(v));
+	}
+	kernels_scalar.ops.convert(&dst[i], &src[i], count - i);
+}
+
+static AVX512 void fill_avx512(uint32_t *dst, uint32_t color, size_t count)
+{
+	__m512i v = _mm512_set1_epi32(color);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16)
+		_mm512_storeu_si512(&dst[i], v);
+	if (i < count)
+		_mm512_mask_storeu_epi32(&dst[i], (1u << (count - i)) - 1, v);
+}
+
+static AVX512 __m512i scale_avx512(__m512i c, __m512i inv)
+{
+	__m512i t = _mm512_mullo_epi16(c, inv);
+
+	t = _mm512_add_epi16(_mm512_add_epi16(t, _mm512_srli_epi16(t, 8)),
+			     _mm512_set1_epi16(0x80));
+	return _mm512_srli_epi16(t, 8);
+}
+
+static AVX512 void blend_avx512(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	const __m512i zero = _mm512_setzero_si512();
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m512i s = _mm512_loadu_si512(&src[i]);
+		__m512i d = _mm512_loadu_si512(&dst[i]);
+		__m512i alpha = _mm512_srli_epi32(s, 24);
+		__m512i inv = _mm512_sub_epi32(_mm512_set1_epi32(0xff), alpha);
+		__m512i lo, hi, r;
+
+		inv = _mm512_or_si512(inv, _mm512_slli_epi32(inv, 16));
+		lo = scale_avx512(_mm512_unpacklo_epi8(d, zero), _mm512_unpacklo_epi32(inv, inv));
+		hi = scale_avx512(_mm512_unpackhi_epi8(d, zero), _mm512_unpackhi_epi32(inv, inv));
+		r = _mm512_add_epi32(s, _mm512_packus_epi16(lo, hi));
+
+		r = _mm512_mask_blend_epi32(_mm512_cmpeq_epi32_mask(alpha, zero), r, d);
+		_mm512_storeu_si512(&dst[i], r);
+	}
+	kernels_scalar.ops.blend(&dst[i], &src[i], count - i);
+}
+
+const struct kernel_set kernels_avx512 = {
+	.name = "avx512",
+	.supported = avx512_supported,
+	.ops = {
+		.copy = copy_avx512,
+		.convert = convert_avx512,
+		.fill = fill_avx512,
+		.blend = blend_avx512,
+	},
+};
+
+#endif
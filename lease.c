@@ -0,0 +1,421 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Lease manager: holds DRM master of a device and hands out DRM leases of single heads. A client
+ * asks for a connector over a Unix socket and gets a file descriptor back which only sees that
+ * connector, its CRTC and the planes of the CRTC. The client is master of its lease and drives
+ * the display directly, the manager is not involved in presenting at all.
+ *
+ * Protocol, one line per request:
+ *   lease <connector>   -> "ok <lessee id>" with the lease fd attached, or "error <reason>"
+ *   revoke <lessee id>  -> "ok" or "error <reason>"
+ *   list                -> "<lessee id>" per lease, then "end"
+ * A lease ends when the client closes the last copy of its fd or when it is revoked.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "drm_framebuffer.h"
+#include "resources.h"
+#include "lease.h"
+
+#define LEASE_MAX_CLIENTS 16
+#define LEASE_MAX_OBJECTS (2 + 32)
+
+/* What a lessee got, the kernel can't tell the lessor about the objects of other leases */
+struct lease {
+	uint32_t lessee;
+	uint32_t crtc_index;
+	uint32_t objects[LEASE_MAX_OBJECTS];
+	uint32_t count;
+};
+
+struct lease_manager {
+	int fd;
+	struct drm_resources res;
+	int listener;
+	int clients[LEASE_MAX_CLIENTS];
+	struct lease leases[LEASE_MAX_CLIENTS];
+	uint32_t lease_count;
+};
+
+static int send_reply(int sock, int fd, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static int send_reply(int sock, int fd, const char *fmt, ...)
+{
+	char line[256];
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov;
+	struct msghdr msg;
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+
+	iov.iov_base = line;
+	iov.iov_len = strlen(line);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (fd >= 0) {
+		struct cmsghdr *cmsg;
+
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) < 0 ? -errno : 0;
+}
+
+/* Forgets the leases which were revoked or whose client closed the lease fd */
+static void prune_leases(struct lease_manager *lm)
+{
+	drmModeLesseeListPtr list = drmModeListLessees(lm->fd);
+	uint32_t kept = 0;
+
+	for (uint32_t i = 0; i < lm->lease_count; i++) {
+		for (uint32_t j = 0; list && j < list->count; j++) {
+			if (list->lessees[j] == lm->leases[i].lessee) {
+				lm->leases[kept++] = lm->leases[i];
+				break;
+			}
+		}
+	}
+	lm->lease_count = kept;
+	drmFree(list);
+}
+
+static int leased(struct lease_manager *lm, uint32_t id)
+{
+	for (uint32_t i = 0; i < lm->lease_count; i++) {
+		for (uint32_t j = 0; j < lm->leases[i].count; j++) {
+			if (lm->leases[i].objects[j] == id)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int create_lease(struct lease_manager *lm, const char *connector_name, uint32_t *lessee)
+{
+	struct drm_resources *r = &lm->res;
+	struct lease *lease;
+	uint32_t crtc_id, taken = 0;
+	int index, crtc_index, planes, fd, err;
+
+	if (lm->lease_count == LEASE_MAX_CLIENTS)
+		return -EBUSY;
+	prune_leases(lm);
+	lease = &lm->leases[lm->lease_count];
+	lease->count = 0;
+
+	/* Heads may have been switched or plugged since the last request */
+	drm_resources_release(r);
+	err = drm_resources_load(lm->fd, r);
+	if (err)
+		return err;
+
+	index = drm_resources_find_connector(r, connector_name);
+	if (index < 0 || !r->connectors[index])
+		return -ENOENT;
+	if (leased(lm, r->connectors[index]->connector_id))
+		return -EBUSY;
+
+	for (uint32_t i = 0; i < lm->lease_count; i++)
+		taken |= 1u << lm->leases[i].crtc_index;
+	crtc_id = drm_resources_find_crtc(r, r->connectors[index], taken);
+	crtc_index = drm_resources_crtc_index(r, crtc_id);
+	if (!crtc_id || crtc_index < 0)
+		return -ENODEV;
+
+	lease->objects[lease->count++] = r->connectors[index]->connector_id;
+	lease->objects[lease->count++] = crtc_id;
+
+	/* Planes which can only be used on this CRTC, shared overlays would block other heads */
+	planes = drm_resources_load_planes(r);
+	for (int i = 0; i < planes && lease->count < LEASE_MAX_OBJECTS; i++) {
+		if (r->planes[i] && r->planes[i]->possible_crtcs == 1u << crtc_index &&
+		    !leased(lm, r->planes[i]->plane_id))
+			lease->objects[lease->count++] = r->planes[i]->plane_id;
+	}
+
+	fd = drmModeCreateLease(lm->fd, lease->objects, lease->count, O_CLOEXEC, lessee);
+	if (fd < 0)
+		return fd;
+
+	lease->lessee = *lessee;
+	lease->crtc_index = crtc_index;
+	lm->lease_count++;
+
+	return fd;
+}
+
+static void handle_request(struct lease_manager *lm, int sock, char *line)
+{
+	char name[32];
+	uint32_t lessee;
+	int fd;
+
+	if (sscanf(line, "lease %31s", name) == 1) {
+		fd = create_lease(lm, name, &lessee);
+		if (fd < 0) {
+			send_reply(sock, -1, "error %s\n", strerror(-fd));
+			return;
+		}
+		print_verbose("Leased %s as lessee %u\n", name, lessee);
+		send_reply(sock, fd, "ok %u\n", lessee);
+		/* The client has its own copy now */
+		close(fd);
+	} else if (sscanf(line, "revoke %u", &lessee) == 1) {
+		if (drmModeRevokeLease(lm->fd, lessee))
+			send_reply(sock, -1, "error %s\n", strerror(errno));
+		else
+			send_reply(sock, -1, "ok\n");
+	} else if (strncmp(line, "list", 4) == 0) {
+		drmModeLesseeListPtr list = drmModeListLessees(lm->fd);
+
+		for (uint32_t i = 0; list && i < list->count; i++)
+			send_reply(sock, -1, "%u\n", list->lessees[i]);
+		send_reply(sock, -1, "end\n");
+		drmFree(list);
+	} else {
+		send_reply(sock, -1, "error unknown request\n");
+	}
+}
+
+/* Requests are short, one read is one request */
+static int handle_client(struct lease_manager *lm, int sock)
+{
+	char line[128];
+	ssize_t len;
+
+	len = recv(sock, line, sizeof(line) - 1, 0);
+	if (len <= 0)
+		return -1;
+	line[len] = '\0';
+	line[strcspn(line, "\r\n")] = '\0';
+
+	handle_request(lm, sock, line);
+
+	return 0;
+}
+
+static int open_listener(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	int sock;
+	int err;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long\n", socket_path);
+		return -EINVAL;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	unlink(socket_path);
+	/* A lease is full modesetting control, so only the owner may connect. That is set before
+	 * listen(), until then connecting fails anyway. */
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || chmod(socket_path, 0600) ||
+	    listen(sock, 8)) {
+		err = -errno;
+		printf("Could not listen on %s (err=%d)\n", socket_path, err);
+		close(sock);
+		return err;
+	}
+
+	return sock;
+}
+
+int run_lease_manager(const char *dri_device, const char *socket_path)
+{
+	struct lease_manager lm;
+	int err;
+
+	memset(&lm, 0, sizeof(lm));
+	lm.listener = -1;
+	for (int i = 0; i < LEASE_MAX_CLIENTS; i++)
+		lm.clients[i] = -1;
+
+	lm.fd = open(dri_device, O_RDWR | O_CLOEXEC);
+	if (lm.fd < 0) {
+		printf("Could not open dri device %s\n", dri_device);
+		return -EINVAL;
+	}
+
+	/* Leases can only be created by the master, which is kept for the whole time */
+	err = drmSetMaster(lm.fd);
+	if (err) {
+		printf("Could not get master role for DRM.\n");
+		goto cleanup;
+	}
+
+	drmSetClientCap(lm.fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+	err = drm_resources_load(lm.fd, &lm.res);
+	if (err)
+		goto cleanup;
+
+	lm.listener = open_listener(socket_path);
+	if (lm.listener < 0) {
+		err = lm.listener;
+		goto cleanup;
+	}
+
+	print_verbose("Leasing connectors of %s on %s\n", dri_device, socket_path);
+
+	catch_termination();
+
+	while (!terminate) {
+		struct pollfd pfds[1 + LEASE_MAX_CLIENTS];
+
+		pfds[0].fd = lm.listener;
+		pfds[0].events = POLLIN;
+		for (int i = 0; i < LEASE_MAX_CLIENTS; i++) {
+			pfds[1 + i].fd = lm.clients[i];
+			pfds[1 + i].events = POLLIN;
+		}
+
+		if (poll(pfds, ARRAY_SIZE(pfds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		for (int i = 0; i < LEASE_MAX_CLIENTS; i++) {
+			if (pfds[1 + i].revents && handle_client(&lm, lm.clients[i])) {
+				close(lm.clients[i]);
+				lm.clients[i] = -1;
+			}
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			int sock = accept4(lm.listener, NULL, NULL, SOCK_CLOEXEC);
+			int i;
+
+			for (i = 0; sock >= 0 && i < LEASE_MAX_CLIENTS; i++) {
+				if (lm.clients[i] < 0) {
+					lm.clients[i] = sock;
+					break;
+				}
+			}
+			if (sock >= 0 && i == LEASE_MAX_CLIENTS) {
+				send_reply(sock, -1, "error too many clients\n");
+				close(sock);
+			}
+		}
+	}
+
+	unlink(socket_path);
+
+cleanup:
+	for (int i = 0; i < LEASE_MAX_CLIENTS; i++) {
+		if (lm.clients[i] >= 0)
+			close(lm.clients[i]);
+	}
+	if (lm.listener >= 0)
+		close(lm.listener);
+	drm_resources_release(&lm.res);
+	/* Closing the lessor revokes all leases */
+	close(lm.fd);
+
+	return err;
+}
+
+/* Asks the lease manager for a connector, returns the lease fd */
+int lease_request(const char *socket_path, const char *connector_name)
+{
+	struct sockaddr_un addr;
+	char line[256];
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { line, sizeof(line) - 1 };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int sock, fd = -1;
+	ssize_t len;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("Could not connect to the lease manager on %s\n", socket_path);
+		close(sock);
+		return -ECONNREFUSED;
+	}
+
+	len = snprintf(line, sizeof(line), "lease %s\n", connector_name);
+	if (send(sock, line, len, MSG_NOSIGNAL) != len) {
+		close(sock);
+		return -EIO;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	close(sock);
+	if (len <= 0)
+		return -EIO;
+	line[len] = '\0';
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+
+	if (strncmp(line, "ok", 2) || fd < 0) {
+		printf("Could not lease %s: %s", connector_name, line);
+		if (fd >= 0)
+			close(fd);
+		return -EBUSY;
+	}
+
+	return fd;
+}
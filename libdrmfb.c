@@ -0,0 +1,204 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+#include "kernels.h"
+#include "libdrmfb.h"
+
+#define DRMFB_BUFFERS 3
+
+struct drmfb {
+	struct framebuffer fb;
+	/* Buffer 0 is the one of the framebuffer, the others are created on top */
+	struct dumb_buffer extra[DRMFB_BUFFERS - 1];
+	struct drmfb_buffer buffers[DRMFB_BUFFERS];
+	uint32_t fb_ids[DRMFB_BUFFERS];
+	int front;
+	/* Queued for the next vblank, -1 if none */
+	int queued;
+	/* Handed out to be rendered to, -1 if none */
+	int back;
+	uint64_t frames;
+};
+
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+			      unsigned int tv_usec, void *user_data)
+{
+	struct drmfb *drmfb = user_data;
+
+	if (drmfb->queued < 0)
+		return;
+	drmfb->front = drmfb->queued;
+	drmfb->queued = -1;
+	drmfb->frames++;
+}
+
+int drmfb_open(const char *device, const char *connector, struct drmfb **drmfb)
+{
+	struct drmfb *d;
+	int err;
+
+	/* Errors are returned, the program decides what to tell the user */
+	quiet = 1;
+	kernels_init(NULL);
+
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+	d->queued = -1;
+	d->back = -1;
+
+	err = get_framebuffer(device, connector, NULL, NULL, &d->fb);
+	if (err) {
+		free(d);
+		return err < 0 ? err : -EINVAL;
+	}
+
+	d->buffers[0].pixels = (uint32_t *)d->fb.data;
+	d->buffers[0].stride = d->fb.dumb_framebuffer.pitch / 4;
+	d->fb_ids[0] = d->fb.buffer_id;
+	for (int i = 1; i < DRMFB_BUFFERS; i++) {
+		struct dumb_buffer *buf = &d->extra[i - 1];
+
+		err = create_dumb_buffer(d->fb.fd, d->fb.res_x, d->fb.res_y, DRM_FORMAT_XRGB8888,
+					 buf);
+		if (err)
+			goto cleanup;
+		d->buffers[i].pixels = (uint32_t *)buf->data;
+		d->buffers[i].stride = buf->pitch / 4;
+		d->fb_ids[i] = buf->fb_id;
+	}
+	for (int i = 0; i < DRMFB_BUFFERS; i++) {
+		d->buffers[i].width = d->fb.res_x;
+		d->buffers[i].height = d->fb.res_y;
+	}
+
+	err = show_framebuffer(&d->fb);
+	if (err)
+		goto cleanup;
+
+	*drmfb = d;
+
+	return 0;
+
+cleanup:
+	drmfb_close(d);
+	return err < 0 ? err : -EINVAL;
+}
+
+void drmfb_close(struct drmfb *drmfb)
+{
+	/* The extra buffers can't be destroyed while they are on the display */
+	if (drmfb->queued >= 0)
+		drmfb_dispatch(drmfb, 100);
+	if (drmfb->front != 0 && drmfb->fb.crtc)
+		scanout_framebuffer(&drmfb->fb, drmfb->fb.buffer_id, 0, 0);
+
+	for (int i = 0; i < DRMFB_BUFFERS - 1; i++)
+		destroy_dumb_buffer(drmfb->fb.fd, &drmfb->extra[i]);
+	release_framebuffer(&drmfb->fb);
+	free(drmfb);
+}
+
+void drmfb_size(const struct drmfb *drmfb, uint32_t *width, uint32_t *height)
+{
+	*width = drmfb->fb.res_x;
+	*height = drmfb->fb.res_y;
+}
+
+int drmfb_acquire(struct drmfb *drmfb, struct drmfb_buffer *buffer)
+{
+	/* Take in completed flips, so the buffer which left the display can be reused */
+	if (drmfb->queued >= 0)
+		drmfb_dispatch(drmfb, 0);
+
+	if (drmfb->back < 0) {
+		for (int i = 0; i < DRMFB_BUFFERS; i++) {
+			if (i != drmfb->front && i != drmfb->queued) {
+				drmfb->back = i;
+				break;
+			}
+		}
+	}
+	*buffer = drmfb->buffers[drmfb->back];
+
+	return 0;
+}
+
+int drmfb_present(struct drmfb *drmfb)
+{
+	struct framebuffer *fb = &drmfb->fb;
+	int err;
+
+	if (drmfb->back < 0)
+		return -EINVAL;
+
+	/* Only one flip can be queued per CRTC */
+	while (drmfb->queued >= 0) {
+		err = drmfb_dispatch(drmfb, -1);
+		if (err)
+			return err;
+	}
+
+	err = master_acquire(fb);
+	if (err)
+		return err;
+	err = drmModePageFlip(fb->fd, fb->crtc->crtc_id, drmfb->fb_ids[drmfb->back],
+			      DRM_MODE_PAGE_FLIP_EVENT, drmfb);
+	master_release(fb);
+	if (err)
+		return err;
+
+	drmfb->queued = drmfb->back;
+	drmfb->back = -1;
+
+	return 0;
+}
+
+int drmfb_fd(const struct drmfb *drmfb)
+{
+	return drmfb->fb.fd;
+}
+
+int drmfb_dispatch(struct drmfb *drmfb, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = drmfb->fb.fd, .events = POLLIN };
+	drmEventContext ev = {
+		.version = 2,
+		.page_flip_handler = page_flip_handler,
+	};
+	int ret;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -errno;
+	if (ret == 0)
+		return 0;
+
+	return drmHandleEvent(drmfb->fb.fd, &ev) ? -EIO : 0;
+}
+
+uint64_t drmfb_frames(const struct drmfb *drmfb)
+{
+	return drmfb->frames;
+}
@@ -0,0 +1,87 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libdrmfb: lets a program render straight into the scanout buffers of a display, without a pipe
+ * to the drm-framebuffer tool in between.
+ *
+ *	struct drmfb *drmfb;
+ *	struct drmfb_buffer buf;
+ *
+ *	drmfb_open("/dev/dri/card0", "HDMI-A-1", &drmfb);
+ *	for (;;) {
+ *		drmfb_acquire(drmfb, &buf);
+ *		render(buf.pixels, buf.width, buf.height, buf.stride);
+ *		drmfb_present(drmfb);
+ *	}
+ *	drmfb_close(drmfb);
+ *
+ * Pixels are XRGB8888. There are three buffers, so acquire never waits for the display: one is
+ * shown, one may be queued for the next vblank and one is rendered to. present only waits if the
+ * previous frame is still queued. Completed flips are handled by acquire and present, a program
+ * with its own event loop can poll drmfb_fd() and call drmfb_dispatch() instead.
+ *
+ * All functions return 0 or a negative errno value and print nothing. Only the drmfb_* and
+ * pattern_* symbols are exported, the rest of the library is hidden.
+ */
+
+#ifndef LIBDRMFB_H
+#define LIBDRMFB_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The library is built with -fvisibility=hidden */
+#pragma GCC visibility push(default)
+
+struct drmfb;
+
+struct drmfb_buffer {
+	uint32_t *pixels;
+	uint32_t width;
+	uint32_t height;
+	/* Distance between rows in pixels */
+	uint32_t stride;
+};
+
+/* Sets the preferred mode of the connector and shows a black screen */
+int drmfb_open(const char *device, const char *connector, struct drmfb **drmfb);
+/* Restores what was shown before drmfb_open() */
+void drmfb_close(struct drmfb *drmfb);
+
+void drmfb_size(const struct drmfb *drmfb, uint32_t *width, uint32_t *height);
+
+/* Buffer to render the next frame to, the same one until it is presented */
+int drmfb_acquire(struct drmfb *drmfb, struct drmfb_buffer *buffer);
+/* Shows the acquired buffer at the next vblank */
+int drmfb_present(struct drmfb *drmfb);
+
+/* Readable when a flip completed */
+int drmfb_fd(const struct drmfb *drmfb);
+/* Handles completed flips, waits up to timeout_ms for one, -1 waits forever */
+int drmfb_dispatch(struct drmfb *drmfb, int timeout_ms);
+/* Number of frames which reached the display */
+uint64_t drmfb_frames(const struct drmfb *drmfb);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
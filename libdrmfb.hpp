@@ -0,0 +1,290 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * C++ layer of libdrmfb. The pixel formats and operations of a blit are template parameters, so
+ * every combination compiles into its own inlined loop without a branch per pixel:
+ *
+ *	using namespace libdrmfb;
+ *
+ *	display display("/dev/dri/card0", "HDMI-A-1");
+ *	view<rgb565> frame(data, 640, 480, 640 * 2);
+ *
+ *	blit<rgb565, xrgb8888, copy, nearest>(frame, display.acquire());
+ *	display.present();
+ *
+ * Pixels pass between formats as premultiplied ARGB8888 in a uint32_t. Copies between equal
+ * formats are plain row copies. Needs C++17.
+ */
+
+#ifndef LIBDRMFB_HPP
+#define LIBDRMFB_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <system_error>
+#include <type_traits>
+
+#include "libdrmfb.h"
+
+namespace libdrmfb
+{
+
+/* Formats, named like the DRM fourcc codes, in their little endian memory layout */
+
+struct xrgb8888 {
+	static constexpr unsigned bytes = 4;
+	static uint32_t load(const uint8_t *p)
+	{
+		uint32_t v;
+
+		std::memcpy(&v, p, 4);
+		return v | 0xff000000;
+	}
+	static void store(uint8_t *p, uint32_t argb)
+	{
+		std::memcpy(p, &argb, 4);
+	}
+};
+
+/* Premultiplied alpha like the surfaces of stream mode */
+struct argb8888 {
+	static constexpr unsigned bytes = 4;
+	static uint32_t load(const uint8_t *p)
+	{
+		uint32_t v;
+
+		std::memcpy(&v, p, 4);
+		return v;
+	}
+	static void store(uint8_t *p, uint32_t argb)
+	{
+		std::memcpy(p, &argb, 4);
+	}
+};
+
+struct rgb888 {
+	static constexpr unsigned bytes = 3;
+	static uint32_t load(const uint8_t *p)
+	{
+		return 0xff000000 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+	}
+	static void store(uint8_t *p, uint32_t argb)
+	{
+		p[0] = argb;
+		p[1] = argb >> 8;
+		p[2] = argb >> 16;
+	}
+};
+
+struct rgb565 {
+	static constexpr unsigned bytes = 2;
+	static uint32_t load(const uint8_t *p)
+	{
+		uint32_t v = p[0] | p[1] << 8;
+		uint32_t r = (v >> 11) & 0x1f, g = (v >> 5) & 0x3f, b = v & 0x1f;
+
+		/* Repeat the high bits, so full intensity stays 0xff */
+		return 0xff000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) |
+		       (b << 3 | b >> 2);
+	}
+	static void store(uint8_t *p, uint32_t argb)
+	{
+		uint32_t v = ((argb >> 8) & 0xf800) | ((argb >> 5) & 0x07e0) | ((argb >> 3) & 0x001f);
+
+		p[0] = v;
+		p[1] = v >> 8;
+	}
+};
+
+/* Operations, how a source pixel ends up in the destination */
+
+struct copy {
+	static constexpr bool reads_dst = false;
+	static uint32_t apply(uint32_t src, uint32_t)
+	{
+		return src;
+	}
+};
+
+/* dst = src + dst * (1 - src_alpha), the same rounding as the compositor */
+struct blend {
+	static constexpr bool reads_dst = true;
+	static uint32_t apply(uint32_t src, uint32_t dst)
+	{
+		uint32_t a = src >> 24;
+		uint32_t inv = 0xff - a;
+		uint32_t rb = (dst & 0x00ff00ff) * inv;
+		uint32_t ag = ((dst >> 8) & 0x00ff00ff) * inv;
+
+		rb = ((rb + ((rb >> 8) & 0x00ff00ff) + 0x00800080) >> 8) & 0x00ff00ff;
+		ag = (ag + ((ag >> 8) & 0x00ff00ff) + 0x00800080) & 0xff00ff00;
+		return src + (rb | ag);
+	}
+};
+
+/* Scaling, how destination pixels map to source pixels */
+
+/* 1:1, the overlapping part of both views is blitted */
+struct unscaled {
+};
+
+/* The whole source is stretched over the whole destination */
+struct nearest {
+};
+
+template <class Format> struct view {
+	uint8_t *data;
+	uint32_t width;
+	uint32_t height;
+	/* Bytes between rows */
+	uint32_t pitch;
+
+	view(void *data, uint32_t width, uint32_t height, uint32_t pitch)
+		: data(static_cast<uint8_t *>(data)), width(width), height(height), pitch(pitch)
+	{
+	}
+
+	/* A buffer of the library is always XRGB8888 */
+	template <class F = Format, class = std::enable_if_t<std::is_same_v<F, xrgb8888>>>
+	view(const drmfb_buffer &buffer)
+		: view(buffer.pixels, buffer.width, buffer.height, buffer.stride * 4)
+	{
+	}
+
+	uint8_t *row(uint32_t y) const
+	{
+		return data + (size_t)y * pitch;
+	}
+};
+
+namespace detail
+{
+
+template <class Src, class Dst, class Op>
+inline void row(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+	if constexpr (std::is_same_v<Src, Dst> && std::is_same_v<Op, copy>) {
+		std::memcpy(dst, src, (size_t)n * Src::bytes);
+	} else {
+		/* A size_t index keeps the addresses linear, so the compiler can vectorize */
+		for (size_t x = 0; x < n; x++) {
+			uint32_t d = 0;
+
+			if constexpr (Op::reads_dst)
+				d = Dst::load(dst + x * Dst::bytes);
+			Dst::store(dst + x * Dst::bytes, Op::apply(Src::load(src + x * Src::bytes), d));
+		}
+	}
+}
+
+template <class Src, class Dst, class Op>
+inline void row_scaled(uint8_t *dst, const uint8_t *src, uint32_t n, uint64_t step)
+{
+	uint64_t sx = 0;
+
+	for (uint32_t x = 0; x < n; x++, sx += step) {
+		uint32_t d = 0;
+
+		if constexpr (Op::reads_dst)
+			d = Dst::load(dst + x * Dst::bytes);
+		Dst::store(dst + x * Dst::bytes,
+			   Op::apply(Src::load(src + (sx >> 16) * Src::bytes), d));
+	}
+}
+
+} // namespace detail
+
+template <class Src, class Dst, class Op = copy, class Scale = unscaled>
+inline void blit(const view<Src> &src, const view<Dst> &dst)
+{
+	if constexpr (std::is_same_v<Scale, nearest>) {
+		if (!dst.width || !dst.height)
+			return;
+
+		/* 16.16 fixed point steps like the image loader */
+		uint64_t step_x = ((uint64_t)src.width << 16) / dst.width;
+		uint64_t step_y = ((uint64_t)src.height << 16) / dst.height;
+
+		for (uint32_t y = 0; y < dst.height; y++)
+			detail::row_scaled<Src, Dst, Op>(dst.row(y), src.row((y * step_y) >> 16),
+							 dst.width, step_x);
+	} else {
+		uint32_t w = src.width < dst.width ? src.width : dst.width;
+		uint32_t h = src.height < dst.height ? src.height : dst.height;
+
+		for (uint32_t y = 0; y < h; y++)
+			detail::row<Src, Dst, Op>(dst.row(y), src.row(y), w);
+	}
+}
+
+/* Owns a struct drmfb, errors are thrown as std::system_error */
+class display
+{
+public:
+	display(const char *device, const char *connector)
+	{
+		check(drmfb_open(device, connector, &drmfb_));
+	}
+	~display()
+	{
+		drmfb_close(drmfb_);
+	}
+	display(const display &) = delete;
+	display &operator=(const display &) = delete;
+
+	view<xrgb8888> acquire()
+	{
+		drmfb_buffer buffer;
+
+		check(drmfb_acquire(drmfb_, &buffer));
+		return view<xrgb8888>(buffer);
+	}
+	void present()
+	{
+		check(drmfb_present(drmfb_));
+	}
+
+	int fd() const
+	{
+		return drmfb_fd(drmfb_);
+	}
+	void dispatch(int timeout_ms)
+	{
+		check(drmfb_dispatch(drmfb_, timeout_ms));
+	}
+	uint64_t frames() const
+	{
+		return drmfb_frames(drmfb_);
+	}
+	struct drmfb *get() const
+	{
+		return drmfb_;
+	}
+
+private:
+	static void check(int err)
+	{
+		if (err)
+			throw std::system_error(-err, std::generic_category());
+	}
+
+	struct drmfb *drmfb_;
+};
+
+} // namespace libdrmfb
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Looped playback of a short clip. All frames are read from stdin into their own scanout buffer
+ * up front, afterwards playback only flips between them. No pixel is copied while the loop is
+ * running, so the timing on the display only depends on the driver and the hardware.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+#include "loop.h"
+#include "vblank.h"
+
+struct loop {
+	struct framebuffer *fb;
+	struct dumb_buffer *frames;
+	uint32_t count;
+	/* Vblanks each frame stays on the display */
+	uint32_t hold;
+	int flip_pending;
+	uint64_t flips;
+	uint64_t missed;
+	unsigned int last_sequence;
+};
+
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+			      unsigned int tv_usec, void *user_data)
+{
+	struct loop *loop = user_data;
+
+	if (loop->flips && sequence - loop->last_sequence > loop->hold)
+		loop->missed += sequence - loop->last_sequence - loop->hold;
+
+	loop->last_sequence = sequence;
+	loop->flip_pending = 0;
+	loop->flips++;
+}
+
+static int read_frames(struct loop *loop)
+{
+	struct framebuffer *fb = loop->fb;
+	uint32_t row = fb->res_x * 4;
+
+	for (uint32_t i = 0; i < loop->count; i++) {
+		struct dumb_buffer *frame = &loop->frames[i];
+		int err;
+
+		err = create_dumb_buffer(fb->fd, fb->res_x, fb->res_y, DRM_FORMAT_XRGB8888, frame);
+		if (err)
+			return err;
+
+		for (uint32_t y = 0; y < fb->res_y; y++) {
+			if (fread(&frame->data[y * frame->pitch], 1, row, stdin) != row) {
+				/* Play what we got if the clip is shorter than requested */
+				destroy_dumb_buffer(fb->fd, frame);
+				loop->count = i;
+				return i ? 0 : -EIO;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int flip(struct loop *loop, struct dumb_buffer *frame)
+{
+	struct framebuffer *fb = loop->fb;
+	int err;
+
+	err = master_acquire(fb);
+	if (err)
+		return err;
+	err = drmModePageFlip(fb->fd, fb->crtc->crtc_id, frame->fb_id, DRM_MODE_PAGE_FLIP_EVENT,
+			      loop);
+	master_release(fb);
+
+	if (err) {
+		printf("Page flip failed (err=%d)\n", err);
+		return err;
+	}
+
+	loop->flip_pending = 1;
+
+	return 0;
+}
+
+static int wait_for_flip(struct loop *loop)
+{
+	struct pollfd pfd = { .fd = loop->fb->fd, .events = POLLIN };
+	drmEventContext ev = {
+		.version = 2,
+		.page_flip_handler = page_flip_handler,
+	};
+
+	/* A signal doesn't stop the wait, the flip completes within a frame anyway */
+	while (loop->flip_pending) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		drmHandleEvent(loop->fb->fd, &ev);
+	}
+
+	return 0;
+}
+
+static int wait_vblanks(struct loop *loop, uint32_t count)
+{
+	drmVBlank vbl;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE | vblank_crtc_select(loop->fb->crtc_index);
+	vbl.request.sequence = count;
+
+	return drmWaitVBlank(loop->fb->fd, &vbl);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int run_loop(struct framebuffer *fb, uint32_t count, uint32_t rate)
+{
+	struct loop loop;
+	uint32_t refresh = fb->resolution->vrefresh ? fb->resolution->vrefresh : 60;
+	double start, elapsed;
+	int err;
+
+	memset(&loop, 0, sizeof(loop));
+	loop.fb = fb;
+	loop.count = count;
+	loop.hold = rate && rate < refresh ? (refresh + rate / 2) / rate : 1;
+
+	loop.frames = calloc(count, sizeof(*loop.frames));
+	if (!loop.frames)
+		return -ENOMEM;
+
+	print_verbose("Loading %u frames\n", count);
+	err = read_frames(&loop);
+	if (err)
+		goto cleanup;
+
+	print_verbose("Playing %u frames, each for %u vblanks at %u Hz\n", loop.count, loop.hold,
+		      refresh);
+
+	err = show_framebuffer(fb);
+	if (err)
+		goto cleanup;
+
+	catch_termination();
+
+	start = now();
+	for (uint32_t i = 0; !terminate; i = (i + 1) % loop.count) {
+		err = flip(&loop, &loop.frames[i]);
+		if (!err)
+			err = wait_for_flip(&loop);
+		if (!err && loop.hold > 1 && wait_vblanks(&loop, loop.hold - 1) && !terminate)
+			err = -errno;
+		if (err)
+			break;
+	}
+	elapsed = now() - start;
+
+	printf("Displayed %lu frames in %.3f s, %.2f fps, %lu missed vblanks\n",
+	       (unsigned long)loop.flips, elapsed, elapsed > 0 ? loop.flips / elapsed : 0,
+	       (unsigned long)loop.missed);
+
+	/* Don't pull the frames away while one of them is scanned out */
+	scanout_framebuffer(fb, fb->buffer_id, fb->pan_x, fb->pan_y);
+
+cleanup:
+	for (uint32_t i = 0; i < count; i++)
+		destroy_dumb_buffer(fb->fd, &loop.frames[i]);
+	free(loop.frames);
+
+	return err;
+}
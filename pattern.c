@@ -0,0 +1,252 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Test patterns for display qualification. Most patterns are the same row over and over, or a few
+ * different rows in bands: such a row is built once with the fill kernels and then replicated
+ * with blit(), so drawing runs at copy speed instead of computing every pixel. Only the zone
+ * plate changes from row to row, it computes half a row of one quadrant and mirrors it.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#include "kernels.h"
+#include "blit.h"
+#include "pattern.h"
+
+#define PATTERN_CHECKER_SIZE 64
+#define PATTERN_BOX_SIZE 128
+
+/* 75% bars: gray, yellow, cyan, green, magenta, red, blue */
+static const uint32_t smpte_top[] = { 0xc0c0c0, 0xc0c000, 0x00c0c0, 0x00c000,
+				      0xc000c0, 0xc00000, 0x0000c0 };
+/* Reverse bars below them: blue, black, magenta, black, cyan, black, gray */
+static const uint32_t smpte_middle[] = { 0x0000c0, 0x131313, 0xc000c0, 0x131313,
+					 0x00c0c0, 0x131313, 0xc0c0c0 };
+/* -I, white, +Q, black, then the PLUGE steps -4%, 0, +4% and black */
+static const uint32_t smpte_bottom[] = { 0x00214c, 0xffffff, 0x32006a, 0x131313,
+					 0x090909, 0x131313, 0x1d1d1d, 0x131313 };
+/* Widths of the bottom parts in twelfths of a bar, they add up to seven bars */
+static const uint32_t smpte_bottom_width[] = { 15, 15, 15, 15, 4, 4, 4, 12 };
+
+static const uint32_t ebu[] = { 0xffffff, 0xbfbf00, 0x00bfbf, 0x00bf00,
+				0xbf00bf, 0xbf0000, 0x0000bf, 0x000000 };
+
+int pattern_parse(const char *name, struct pattern *pattern)
+{
+	static const struct {
+		const char *name;
+		enum pattern_type type;
+	} names[] = {
+		{ "solid", PATTERN_SOLID },	  { "smpte", PATTERN_SMPTE },
+		{ "ebu", PATTERN_EBU },		  { "gradient", PATTERN_GRADIENT },
+		{ "checker", PATTERN_CHECKER }, { "zone", PATTERN_ZONE },
+		{ "box", PATTERN_BOX },
+	};
+
+	memset(pattern, 0, sizeof(*pattern));
+	pattern->color = 0xffffff;
+
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcmp(names[i].name, name) == 0) {
+			pattern->type = names[i].type;
+			pattern->size = pattern->type == PATTERN_BOX ? PATTERN_BOX_SIZE :
+								       PATTERN_CHECKER_SIZE;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+/* Splits the row into count parts of the given colors, parts[i] / total of the width each */
+static void bars_row(uint32_t *row, uint32_t width, const uint32_t *colors,
+		     const uint32_t *parts, uint32_t count)
+{
+	uint32_t total = 0, sum = 0, x = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+		total += parts ? parts[i] : 1;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t end;
+
+		sum += parts ? parts[i] : 1;
+		end = (uint64_t)width * sum / total;
+		kernels.fill(&row[x], 0xff000000 | colors[i], end - x);
+		x = end;
+	}
+}
+
+/* Copies row into rows first to first + count */
+static void replicate(const uint32_t *row, uint8_t *dst, uint32_t pitch, uint32_t width,
+		      uint32_t first, uint32_t count)
+{
+	blit(&dst[(size_t)first * pitch], pitch, (const uint8_t *)row, 0, width * 4, count);
+}
+
+static void draw_smpte(uint32_t *row, uint8_t *dst, uint32_t pitch, uint32_t width,
+		       uint32_t height)
+{
+	uint32_t top = height * 2 / 3, middle = height * 3 / 4;
+
+	bars_row(row, width, smpte_top, NULL, 7);
+	replicate(row, dst, pitch, width, 0, top);
+	bars_row(row, width, smpte_middle, NULL, 7);
+	replicate(row, dst, pitch, width, top, middle - top);
+	bars_row(row, width, smpte_bottom, smpte_bottom_width, 8);
+	replicate(row, dst, pitch, width, middle, height - middle);
+}
+
+static void draw_checker(const struct pattern *pattern, uint32_t *row, uint8_t *dst,
+			 uint32_t pitch, uint32_t width, uint32_t height)
+{
+	uint32_t size = pattern->size ? pattern->size : PATTERN_CHECKER_SIZE;
+
+	for (uint32_t y = 0; y < height; y += size) {
+		uint32_t band = height - y < size ? height - y : size;
+		uint32_t phase = (y / size) & 1;
+
+		for (uint32_t x = 0; x < width; x += size)
+			kernels.fill(&row[x], ((x / size) & 1) == phase ? 0xffffffff : 0xff000000,
+				     width - x < size ? width - x : size);
+		replicate(row, dst, pitch, width, y, band);
+	}
+}
+
+static void draw_zone(uint32_t *row, uint8_t *dst, uint32_t pitch, uint32_t width,
+		      uint32_t height)
+{
+	uint32_t cx = width / 2, cy = height / 2;
+	uint32_t half_width = width - cx;
+	/*
+	 * 16.16 factor from the squared radius to 1/256 cycles. The phase is r^2 / (4 * cx) cycles,
+	 * so the frequency r / (2 * cx) reaches Nyquist, half a cycle per pixel, at the edges.
+	 */
+	uint64_t scale = ((uint64_t)64 << 16) / (cx ? cx : 1);
+	uint32_t gray[256];
+	uint32_t *half;
+
+	half = malloc((size_t)(cx > half_width ? cx : half_width) * 4 + 4);
+	if (!half)
+		return;
+
+	for (int i = 0; i < 256; i++) {
+		uint32_t v = lround(127.5 + 127.5 * cos(i * M_PI / 128));
+
+		gray[i] = 0xff000000 | v << 16 | v << 8 | v;
+	}
+
+	/* The plate is symmetric, each row is shown above and below the center */
+	for (uint32_t dy = 0; cy + dy < height || dy <= cy; dy++) {
+		/* r^2 grows by 2 * dx + 1 from one pixel to the next */
+		uint64_t r2 = (uint64_t)dy * dy;
+
+		for (uint32_t dx = 0; dx <= cx || dx < half_width; dx++) {
+			half[dx] = gray[((r2 * scale) >> 16) & 0xff];
+			r2 += 2 * dx + 1;
+		}
+		for (uint32_t x = 0; x < width; x++)
+			row[x] = half[x < cx ? cx - x : x - cx];
+
+		if (cy + dy < height)
+			kernels.copy(&dst[(size_t)(cy + dy) * pitch], row, width * 4);
+		if (dy && dy <= cy)
+			kernels.copy(&dst[(size_t)(cy - dy) * pitch], row, width * 4);
+	}
+
+	free(half);
+}
+
+static void draw_box(const struct pattern *pattern, uint32_t *row, uint8_t *dst, uint32_t pitch,
+		     uint32_t width, uint32_t height)
+{
+	uint32_t size = pattern->size ? pattern->size : PATTERN_BOX_SIZE;
+	uint32_t range_x, range_y, x, y;
+
+	if (size > width)
+		size = width;
+	if (size > height)
+		size = height;
+
+	/* Bounces between the edges, 4 pixels right and 3 down per frame */
+	range_x = width - size;
+	range_y = height - size;
+	x = range_x ? (uint64_t)pattern->frame * 4 % (2 * range_x) : 0;
+	y = range_y ? (uint64_t)pattern->frame * 3 % (2 * range_y) : 0;
+	if (x > range_x)
+		x = 2 * range_x - x;
+	if (y > range_y)
+		y = 2 * range_y - y;
+
+	kernels.fill(row, 0xff000000, width);
+	replicate(row, dst, pitch, width, 0, y);
+	replicate(row, dst, pitch, width, y + size, height - y - size);
+	kernels.fill(&row[x], 0xffffffff, size);
+	replicate(row, dst, pitch, width, y, size);
+}
+
+void pattern_draw(const struct pattern *pattern, uint8_t *dst, uint32_t pitch, uint32_t width,
+		  uint32_t height)
+{
+	uint32_t *row;
+
+	if (!width || !height)
+		return;
+
+	/* The row the other rows are copied from, kept out of the scanout buffer which may be
+	 * uncached and slow to read */
+	row = malloc((size_t)width * 4);
+	if (!row)
+		return;
+
+	switch (pattern->type) {
+	case PATTERN_SOLID:
+		kernels.fill(row, 0xff000000 | pattern->color, width);
+		replicate(row, dst, pitch, width, 0, height);
+		break;
+	case PATTERN_SMPTE:
+		draw_smpte(row, dst, pitch, width, height);
+		break;
+	case PATTERN_EBU:
+		bars_row(row, width, ebu, NULL, 8);
+		replicate(row, dst, pitch, width, 0, height);
+		break;
+	case PATTERN_GRADIENT:
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t v = width > 1 ? x * 255 / (width - 1) : 0;
+
+			row[x] = 0xff000000 | v << 16 | v << 8 | v;
+		}
+		replicate(row, dst, pitch, width, 0, height);
+		break;
+	case PATTERN_CHECKER:
+		draw_checker(pattern, row, dst, pitch, width, height);
+		break;
+	case PATTERN_ZONE:
+		draw_zone(row, dst, pitch, width, height);
+		break;
+	case PATTERN_BOX:
+		draw_box(pattern, row, dst, pitch, width, height);
+		break;
+	default:
+		break;
+	}
+
+	free(row);
+}
@@ -0,0 +1,66 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Part of the public API of libdrmfb, which is built with -fvisibility=hidden */
+#pragma GCC visibility push(default)
+
+enum pattern_type {
+	PATTERN_SOLID,
+	/* SMPTE color bars with the reverse bars and the PLUGE row */
+	PATTERN_SMPTE,
+	/* EBU 100/75 color bars */
+	PATTERN_EBU,
+	/* Black to white from left to right */
+	PATTERN_GRADIENT,
+	PATTERN_CHECKER,
+	/* Circular zone plate, half a cycle per pixel (Nyquist) at the left and right edges */
+	PATTERN_ZONE,
+	/* A white box moving over black, one step per frame */
+	PATTERN_BOX,
+};
+
+struct pattern {
+	enum pattern_type type;
+	/* Color of the solid pattern */
+	uint32_t color;
+	/* Size of the checker squares and of the box in pixels */
+	uint32_t size;
+	/* Animation step of the box */
+	uint32_t frame;
+};
+
+/* Fills in a pattern with its defaults, returns -EINVAL for an unknown name */
+int pattern_parse(const char *name, struct pattern *pattern);
+
+/* Draws the pattern into XRGB8888 pixels, e.g. the mapped scanout buffer */
+void pattern_draw(const struct pattern *pattern, uint8_t *dst, uint32_t pitch, uint32_t width,
+		  uint32_t height);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 
 .global _picture_start
 .type _picture_start, @object
+.balign 4
 _picture_start:
 .incbin "logo.dat"
 
@@ -0,0 +1,110 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Strip pipeline: decodes, converts, scales and writes an image in strips of rows which fit into
+ * the L2 cache, so every stage reads what the previous one wrote while it is still in the cache.
+ * The only full size write is the one into the destination, e.g. a scanout buffer. The image is
+ * never held completely in memory.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "kernels.h"
+#include "pipeline.h"
+
+/* Used if the cache size is unknown */
+#define PIPELINE_L2_SIZE (256 * 1024)
+
+/* Half of L2, the rest is for the destination rows and the decoder input */
+static uint32_t strip_rows(uint32_t width, uint32_t height)
+{
+	long l2 = -1;
+	uint32_t rows;
+
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+	if (l2 <= 0)
+		l2 = PIPELINE_L2_SIZE;
+
+	rows = l2 / 2 / ((size_t)width * 4);
+	if (rows < 1)
+		rows = 1;
+	if (rows > height)
+		rows = height;
+
+	return rows;
+}
+
+int pipeline_run(struct pipeline *p)
+{
+	struct strip_source *source = p->source;
+	uint32_t rows = strip_rows(source->width, source->height);
+	uint64_t step_x = ((uint64_t)p->src_w << 16) / p->w;
+	uint64_t step_y = ((uint64_t)p->src_h << 16) / p->h;
+	/* The strip holds the source rows first to first + count */
+	uint32_t first = 0, count = 0;
+	uint32_t *strip;
+
+	strip = malloc((size_t)rows * source->width * 4);
+	if (!strip)
+		return -ENOMEM;
+
+	memset(&p->stats, 0, sizeof(p->stats));
+
+	for (uint32_t y = 0; y < p->dst_height; y++) {
+		uint32_t *out = (uint32_t *)(p->dst + (size_t)y * p->dst_pitch);
+		const uint32_t *in;
+		uint32_t sy;
+
+		p->stats.bytes_written += (uint64_t)p->dst_width * 4;
+
+		if (y < p->y || y >= p->y + p->h) {
+			kernels.fill(out, 0, p->dst_width);
+			continue;
+		}
+
+		/* Rows only go down, a strip is decoded once and then left behind */
+		sy = p->src_y + (((y - p->y) * step_y) >> 16);
+		while (sy >= first + count) {
+			first += count;
+			count = source->height - first < rows ? source->height - first : rows;
+			source->read_rows(source, strip, count);
+			p->stats.bytes_written += (uint64_t)count * source->width * 4;
+		}
+		in = &strip[(size_t)(sy - first) * source->width + p->src_x];
+
+		kernels.fill(out, 0, p->x);
+		if (step_x == 1 << 16) {
+			kernels.copy(&out[p->x], in, (size_t)p->w * 4);
+		} else {
+			uint64_t sx = 0;
+
+			for (uint32_t x = 0; x < p->w; x++, sx += step_x)
+				out[p->x + x] = in[sx >> 16];
+		}
+		kernels.fill(&out[p->x + p->w], 0, p->dst_width - p->x - p->w);
+		p->stats.bytes_read += (uint64_t)p->w * 4;
+	}
+
+	p->stats.bytes_read += source->bytes_read;
+	free(strip);
+
+	return 0;
+}
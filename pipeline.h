@@ -0,0 +1,53 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+/* Produces the rows of an image from the top, already converted to XRGB8888 */
+struct strip_source {
+	uint32_t width;
+	uint32_t height;
+	/* Writes the next count rows of width pixels to rows */
+	void (*read_rows)(struct strip_source *source, uint32_t *rows, uint32_t count);
+	/* Bytes the source read from its input so far, for the statistics */
+	uint64_t bytes_read;
+};
+
+struct pipeline_stats {
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+};
+
+/*
+ * Places the src_w x src_h area at src_x/src_y of the source into the w x h area at x/y of the
+ * destination, scaled by nearest neighbour. The rest of the destination becomes black.
+ */
+struct pipeline {
+	struct strip_source *source;
+	uint32_t src_x, src_y, src_w, src_h;
+	uint8_t *dst;
+	uint32_t dst_pitch;
+	uint32_t dst_width;
+	uint32_t dst_height;
+	uint32_t x, y, w, h;
+	struct pipeline_stats stats;
+};
+
+int pipeline_run(struct pipeline *pipeline);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "planes.h"
+
+const char *plane_type_name(uint32_t type)
+{
+	switch (type) {
+	case DRM_PLANE_TYPE_OVERLAY:
+		return "overlay";
+	case DRM_PLANE_TYPE_PRIMARY:
+		return "primary";
+	case DRM_PLANE_TYPE_CURSOR:
+		return "cursor";
+	}
+
+	return "INVALID";
+}
+
+static void get_plane_properties(int fd, struct plane *plane)
+{
+	drmModeObjectPropertiesPtr props;
+
+	props = drmModeObjectGetProperties(fd, plane->id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return;
+
+	for (uint32_t i = 0; i < props->count_props; i++) {
+		drmModePropertyPtr prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+
+		if (strcmp(prop->name, "type") == 0)
+			plane->type = props->prop_values[i];
+		else if (strcmp(prop->name, "FB_ID") == 0)
+			plane->prop_fb_id = prop->prop_id;
+		else if (strcmp(prop->name, "CRTC_ID") == 0)
+			plane->prop_crtc_id = prop->prop_id;
+		else if (strcmp(prop->name, "SRC_X") == 0)
+			plane->prop_src_x = prop->prop_id;
+		else if (strcmp(prop->name, "SRC_Y") == 0)
+			plane->prop_src_y = prop->prop_id;
+		else if (strcmp(prop->name, "SRC_W") == 0)
+			plane->prop_src_w = prop->prop_id;
+		else if (strcmp(prop->name, "SRC_H") == 0)
+			plane->prop_src_h = prop->prop_id;
+		else if (strcmp(prop->name, "CRTC_X") == 0)
+			plane->prop_crtc_x = prop->prop_id;
+		else if (strcmp(prop->name, "CRTC_Y") == 0)
+			plane->prop_crtc_y = prop->prop_id;
+		else if (strcmp(prop->name, "CRTC_W") == 0)
+			plane->prop_crtc_w = prop->prop_id;
+		else if (strcmp(prop->name, "CRTC_H") == 0)
+			plane->prop_crtc_h = prop->prop_id;
+		else if (strcmp(prop->name, "zpos") == 0 &&
+			 !(prop->flags & DRM_MODE_PROP_IMMUTABLE) &&
+			 (prop->flags & DRM_MODE_PROP_RANGE) && prop->count_values == 2) {
+			plane->prop_zpos = prop->prop_id;
+			plane->zpos_max = prop->values[1];
+		}
+
+		drmModeFreeProperty(prop);
+	}
+
+	drmModeFreeObjectProperties(props);
+}
+
+int planes_init(struct framebuffer *fb, struct plane_set *set)
+{
+	drmModePlaneResPtr plane_res;
+
+	memset(set, 0, sizeof(*set));
+
+	/* Without universal planes the kernel only reports overlay planes */
+	drmSetClientCap(fb->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+	set->atomic = drmSetClientCap(fb->fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0;
+
+	set->crtc_index = fb->crtc_index;
+
+	plane_res = drmModeGetPlaneResources(fb->fd);
+	if (!plane_res) {
+		printf("Could not get plane resources\n");
+		return -EINVAL;
+	}
+
+	set->planes = calloc(plane_res->count_planes, sizeof(*set->planes));
+	if (!set->planes) {
+		drmModeFreePlaneResources(plane_res);
+		return -ENOMEM;
+	}
+
+	for (uint32_t i = 0; i < plane_res->count_planes; i++) {
+		struct plane *plane = &set->planes[set->count];
+		drmModePlanePtr p;
+
+		p = drmModeGetPlane(fb->fd, plane_res->planes[i]);
+		if (!p)
+			continue;
+
+		if (!(p->possible_crtcs & (1 << set->crtc_index))) {
+			drmModeFreePlane(p);
+			continue;
+		}
+
+		plane->id = p->plane_id;
+		plane->type = DRM_PLANE_TYPE_OVERLAY;
+		for (uint32_t j = 0; j < p->count_formats; j++) {
+			if (p->formats[j] == DRM_FORMAT_ARGB8888)
+				plane->argb = 1;
+		}
+		drmModeFreePlane(p);
+
+		get_plane_properties(fb->fd, plane);
+
+		if (plane->type == DRM_PLANE_TYPE_PRIMARY && !set->primary)
+			set->primary = plane;
+
+		print_verbose("Plane %u: %s%s\n", plane->id, plane_type_name(plane->type),
+			      plane->argb ? " argb" : "");
+		set->count++;
+	}
+
+	drmModeFreePlaneResources(plane_res);
+
+	return 0;
+}
+
+void planes_release(struct plane_set *set)
+{
+	free(set->planes);
+	memset(set, 0, sizeof(*set));
+}
+
+int plane_add_state(drmModeAtomicReqPtr req, struct plane *plane, uint32_t crtc_id, uint32_t fb_id,
+		    const struct plane_rect *src, const struct plane_rect *dst)
+{
+	int err = 0;
+
+	/* Source coordinates are in 16.16 fixed point */
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_fb_id, fb_id) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_crtc_id, crtc_id) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_src_x,
+					(uint64_t)src->x << 16) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_src_y,
+					(uint64_t)src->y << 16) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_src_w,
+					(uint64_t)src->w << 16) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_src_h,
+					(uint64_t)src->h << 16) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_crtc_x, (int64_t)dst->x) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_crtc_y, (int64_t)dst->y) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_crtc_w, dst->w) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_crtc_h, dst->h) < 0;
+
+	return err ? -ENOMEM : 0;
+}
+
+int plane_add_disable(drmModeAtomicReqPtr req, struct plane *plane)
+{
+	int err = 0;
+
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_fb_id, 0) < 0;
+	err |= drmModeAtomicAddProperty(req, plane->id, plane->prop_crtc_id, 0) < 0;
+
+	return err ? -ENOMEM : 0;
+}
+
+/*
+ * Scan out a buffer with the same format and at least the size of the mode, starting at x/y. With
+ * atomic modesetting only the primary plane changes, else the CRTC is set again without changing
+ * the mode.
+ */
+int planes_scanout(struct framebuffer *fb, struct plane_set *set, uint32_t buffer_id, uint16_t x,
+		   uint16_t y)
+{
+	struct plane *primary = set->atomic ? set->primary : 0;
+	drmModeAtomicReqPtr req;
+	int err = -EINVAL;
+
+	if (primary && (req = drmModeAtomicAlloc())) {
+		/* Source coordinates are in 16.16 fixed point */
+		err = drmModeAtomicAddProperty(req, primary->id, primary->prop_fb_id, buffer_id) < 0 ||
+		      drmModeAtomicAddProperty(req, primary->id, primary->prop_src_x,
+					       (uint64_t)x << 16) < 0 ||
+		      drmModeAtomicAddProperty(req, primary->id, primary->prop_src_y,
+					       (uint64_t)y << 16) < 0;
+
+		/* The request is complete, master is only held for the commit itself */
+		if (!err) {
+			if (master_acquire(fb)) {
+				drmModeAtomicFree(req);
+				return -EACCES;
+			}
+			err = drmModeAtomicCommit(fb->fd, req, 0, 0);
+			master_release(fb);
+		}
+
+		drmModeAtomicFree(req);
+	}
+
+	if (err)
+		err = scanout_framebuffer(fb, buffer_id, x, y);
+
+	return err;
+}
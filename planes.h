@@ -0,0 +1,78 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PLANES_H
+#define PLANES_H
+
+#include <stdint.h>
+
+#include "drm_framebuffer.h"
+
+struct plane {
+	uint32_t id;
+	uint32_t type;
+	/* Plane can scan out DRM_FORMAT_ARGB8888 */
+	int argb;
+	/* Assigned during the current layout */
+	int used;
+	/* Enabled by us in the last commit */
+	int active;
+	/* Managed outside of the surface layout, e.g. by the cursor */
+	int reserved;
+	uint32_t prop_fb_id;
+	uint32_t prop_crtc_id;
+	uint32_t prop_src_x;
+	uint32_t prop_src_y;
+	uint32_t prop_src_w;
+	uint32_t prop_src_h;
+	uint32_t prop_crtc_x;
+	uint32_t prop_crtc_y;
+	uint32_t prop_crtc_w;
+	uint32_t prop_crtc_h;
+	/* Only set if the stacking order of the plane can be changed */
+	uint32_t prop_zpos;
+	uint64_t zpos_max;
+};
+
+struct plane_rect {
+	int32_t x;
+	int32_t y;
+	uint32_t w;
+	uint32_t h;
+};
+
+/* All planes which can be attached to the CRTC of a framebuffer */
+struct plane_set {
+	int atomic;
+	uint32_t crtc_index;
+	uint32_t count;
+	struct plane *planes;
+	struct plane *primary;
+};
+
+int planes_init(struct framebuffer *fb, struct plane_set *set);
+void planes_release(struct plane_set *set);
+
+int plane_add_state(drmModeAtomicReqPtr req, struct plane *plane, uint32_t crtc_id, uint32_t fb_id,
+		    const struct plane_rect *src, const struct plane_rect *dst);
+int plane_add_disable(drmModeAtomicReqPtr req, struct plane *plane);
+
+int planes_scanout(struct framebuffer *fb, struct plane_set *set, uint32_t buffer_id, uint16_t x,
+		   uint16_t y);
+
+const char *plane_type_name(uint32_t type);
+
+#endif
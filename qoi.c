@@ -0,0 +1,133 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Decoder for the "Quite OK Image" format, see https://qoiformat.org/qoi-specification.pdf
+ * The display has no use for alpha, so pixels come out premultiplied as XRGB8888.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "qoi.h"
+
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+/* Same limit as the reference decoder, keeps width * height * 4 well inside size_t */
+#define QOI_PIXELS_MAX 400000000
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_MASK_2 0xc0
+
+static uint32_t read_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint32_t qoi_hash(struct qoi_rgba px)
+{
+	return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static uint32_t qoi_xrgb(struct qoi_rgba px)
+{
+	if (px.a != 0xff) {
+		px.r = (px.r * px.a + 127) / 255;
+		px.g = (px.g * px.a + 127) / 255;
+		px.b = (px.b * px.a + 127) / 255;
+	}
+
+	return 0xff000000 | (uint32_t)px.r << 16 | (uint32_t)px.g << 8 | px.b;
+}
+
+int qoi_decoder_init(struct qoi_decoder *dec, const uint8_t *data, size_t size)
+{
+	uint64_t count;
+
+	if (size < QOI_HEADER_SIZE + QOI_PADDING_SIZE || memcmp(data, "qoif", 4))
+		return -EINVAL;
+
+	memset(dec, 0, sizeof(*dec));
+	dec->width = read_be32(&data[4]);
+	dec->height = read_be32(&data[8]);
+	count = (uint64_t)dec->width * dec->height;
+	if (!count || count > QOI_PIXELS_MAX || data[12] < 3 || data[12] > 4 || data[13] > 1)
+		return -EINVAL;
+
+	dec->data = data;
+	dec->pos = QOI_HEADER_SIZE;
+	dec->end = size - QOI_PADDING_SIZE;
+	dec->px = (struct qoi_rgba){ 0, 0, 0, 0xff };
+
+	return 0;
+}
+
+void qoi_decode_pixels(struct qoi_decoder *dec, uint32_t *pixels, size_t count)
+{
+	const uint8_t *data = dec->data;
+	struct qoi_rgba px = dec->px;
+	size_t pos = dec->pos;
+	uint32_t run = dec->run;
+
+	for (size_t i = 0; i < count; i++) {
+		if (run) {
+			run--;
+		} else if (pos < dec->end) {
+			uint8_t b1 = data[pos++];
+
+			if (b1 == QOI_OP_RGB) {
+				px.r = data[pos];
+				px.g = data[pos + 1];
+				px.b = data[pos + 2];
+				pos += 3;
+			} else if (b1 == QOI_OP_RGBA) {
+				px.r = data[pos];
+				px.g = data[pos + 1];
+				px.b = data[pos + 2];
+				px.a = data[pos + 3];
+				pos += 4;
+			} else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+				px = dec->index[b1];
+			} else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+				px.r += ((b1 >> 4) & 0x03) - 2;
+				px.g += ((b1 >> 2) & 0x03) - 2;
+				px.b += (b1 & 0x03) - 2;
+			} else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+				uint8_t b2 = data[pos++];
+				int vg = (b1 & 0x3f) - 32;
+
+				px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+				px.g += vg;
+				px.b += vg - 8 + (b2 & 0x0f);
+			} else {
+				run = b1 & 0x3f;
+			}
+
+			dec->index[qoi_hash(px)] = px;
+		}
+
+		pixels[i] = qoi_xrgb(px);
+	}
+
+	dec->px = px;
+	dec->pos = pos;
+	dec->run = run;
+}
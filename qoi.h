@@ -0,0 +1,43 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QOI_H
+#define QOI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct qoi_rgba {
+	uint8_t r, g, b, a;
+};
+
+/* Decoding state, so an image can be decoded a few rows at a time */
+struct qoi_decoder {
+	uint32_t width;
+	uint32_t height;
+	const uint8_t *data;
+	size_t pos;
+	size_t end;
+	struct qoi_rgba index[64];
+	struct qoi_rgba px;
+	uint32_t run;
+};
+
+/* Checks the header, data has to stay around while decoding */
+int qoi_decoder_init(struct qoi_decoder *dec, const uint8_t *data, size_t size);
+/* Decodes the next count pixels, in rows from the top */
+void qoi_decode_pixels(struct qoi_decoder *dec, uint32_t *pixels, size_t count);
+
+#endif
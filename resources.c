@@ -0,0 +1,300 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "drm_framebuffer.h"
+#include "resources.h"
+
+struct type_name {
+	unsigned int type;
+	const char *name;
+};
+
+static const struct type_name connector_type_names[] = {
+	{DRM_MODE_CONNECTOR_Unknown, "unknown"},
+	{DRM_MODE_CONNECTOR_VGA, "VGA"},
+	{DRM_MODE_CONNECTOR_DVII, "DVI-I"},
+	{DRM_MODE_CONNECTOR_DVID, "DVI-D"},
+	{DRM_MODE_CONNECTOR_DVIA, "DVI-A"},
+	{DRM_MODE_CONNECTOR_Composite, "composite"},
+	{DRM_MODE_CONNECTOR_SVIDEO, "s-video"},
+	{DRM_MODE_CONNECTOR_LVDS, "LVDS"},
+	{DRM_MODE_CONNECTOR_Component, "component"},
+	{DRM_MODE_CONNECTOR_9PinDIN, "9-pin DIN"},
+	{DRM_MODE_CONNECTOR_DisplayPort, "DP"},
+	{DRM_MODE_CONNECTOR_HDMIA, "HDMI-A"},
+	{DRM_MODE_CONNECTOR_HDMIB, "HDMI-B"},
+	{DRM_MODE_CONNECTOR_TV, "TV"},
+	{DRM_MODE_CONNECTOR_eDP, "eDP"},
+	{DRM_MODE_CONNECTOR_VIRTUAL, "Virtual"},
+	{DRM_MODE_CONNECTOR_DSI, "DSI"},
+	{DRM_MODE_CONNECTOR_DPI, "DPI"},
+};
+
+const char *connector_type_name(unsigned int type)
+{
+	if (type < ARRAY_SIZE(connector_type_names))
+		return connector_type_names[type].name;
+
+	return "INVALID";
+}
+
+/* FNV-1a */
+static uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+
+	return hash;
+}
+
+static int index_of(const uint32_t *ids, int count, uint32_t id)
+{
+	for (int i = 0; i < count; i++) {
+		if (ids[i] == id)
+			return i;
+	}
+
+	return -1;
+}
+
+int drm_resources_load(int fd, struct drm_resources *r)
+{
+	int count;
+
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+
+	r->res = drmModeGetResources(fd);
+	if (!r->res) {
+		print_error("Could not get drm resources\n");
+		return -EINVAL;
+	}
+
+	count = r->res->count_connectors;
+	/* At least twice as many slots as names keeps the probe chains short */
+	r->name_mask = 1;
+	while (r->name_mask < 2 * (uint32_t)count)
+		r->name_mask <<= 1;
+
+	r->connectors = calloc(count, sizeof(*r->connectors));
+	r->names = calloc(count, sizeof(*r->names));
+	r->encoders = calloc(r->res->count_encoders, sizeof(*r->encoders));
+	r->crtcs = calloc(r->res->count_crtcs, sizeof(*r->crtcs));
+	r->name_table = malloc(r->name_mask * sizeof(*r->name_table));
+	if ((count && (!r->connectors || !r->names)) ||
+	    (r->res->count_encoders && !r->encoders) || (r->res->count_crtcs && !r->crtcs) ||
+	    !r->name_table) {
+		drm_resources_release(r);
+		return -ENOMEM;
+	}
+	r->name_mask--;
+	memset(r->name_table, 0xff, (r->name_mask + 1) * sizeof(*r->name_table));
+
+	for (int i = 0; i < count; i++) {
+		drmModeConnectorPtr connector;
+		uint32_t slot;
+
+		connector = drmModeGetConnectorCurrent(fd, r->res->connectors[i]);
+		if (!connector)
+			continue;
+
+		r->connectors[i] = connector;
+		snprintf(r->names[i], sizeof(r->names[i]), "%s-%u",
+			 connector_type_name(connector->connector_type),
+			 connector->connector_type_id);
+
+		for (slot = hash_name(r->names[i]) & r->name_mask; r->name_table[slot] >= 0;
+		     slot = (slot + 1) & r->name_mask)
+			;
+		r->name_table[slot] = i;
+	}
+
+	return 0;
+}
+
+void drm_resources_release(struct drm_resources *r)
+{
+	if (!r->res)
+		return;
+
+	for (int i = 0; r->connectors && i < r->res->count_connectors; i++)
+		drmModeFreeConnector(r->connectors[i]);
+	for (int i = 0; r->encoders && i < r->res->count_encoders; i++)
+		drmModeFreeEncoder(r->encoders[i]);
+	for (int i = 0; r->crtcs && i < r->res->count_crtcs; i++)
+		drmModeFreeCrtc(r->crtcs[i]);
+	if (r->plane_res) {
+		for (uint32_t i = 0; i < r->plane_res->count_planes; i++)
+			drmModeFreePlane(r->planes[i]);
+		drmModeFreePlaneResources(r->plane_res);
+	}
+
+	free(r->connectors);
+	free(r->names);
+	free(r->encoders);
+	free(r->crtcs);
+	free(r->planes);
+	free(r->name_table);
+	drmModeFreeResources(r->res);
+	memset(r, 0, sizeof(*r));
+}
+
+/* Index of the connector called e.g. "HDMI-A-1", the name is also known after it was taken */
+int drm_resources_find_connector(struct drm_resources *r, const char *name)
+{
+	for (uint32_t slot = hash_name(name) & r->name_mask; r->name_table[slot] >= 0;
+	     slot = (slot + 1) & r->name_mask) {
+		int i = r->name_table[slot];
+
+		if (strcmp(r->names[i], name) == 0)
+			return i;
+	}
+
+	return -ENOENT;
+}
+
+/* The caller owns the connector afterwards and frees it with drmModeFreeConnector() */
+drmModeConnectorPtr drm_resources_take_connector(struct drm_resources *r, int index)
+{
+	drmModeConnectorPtr connector = r->connectors[index];
+
+	r->connectors[index] = NULL;
+
+	return connector;
+}
+
+drmModeEncoderPtr drm_resources_encoder(struct drm_resources *r, uint32_t id)
+{
+	int i = index_of(r->res->encoders, r->res->count_encoders, id);
+
+	if (i < 0)
+		return NULL;
+	if (!r->encoders[i])
+		r->encoders[i] = drmModeGetEncoder(r->fd, id);
+
+	return r->encoders[i];
+}
+
+/* Position in the resources, planes and vblanks refer to CRTCs by it */
+int drm_resources_crtc_index(struct drm_resources *r, uint32_t id)
+{
+	return index_of(r->res->crtcs, r->res->count_crtcs, id);
+}
+
+/* Whether another connector is currently driven by the CRTC */
+static int crtc_in_use(struct drm_resources *r, uint32_t crtc_id, uint32_t connector_id)
+{
+	for (int i = 0; i < r->res->count_connectors; i++) {
+		drmModeConnectorPtr other = r->connectors[i];
+		drmModeEncoderPtr encoder;
+
+		if (!other || other->connector_id == connector_id || !other->encoder_id)
+			continue;
+		encoder = drm_resources_encoder(r, other->encoder_id);
+		if (encoder && encoder->crtc_id == crtc_id)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * The CRTC driving the connector, or the first one its encoders can drive if it is off. CRTCs
+ * whose index is set in taken and CRTCs which drive another connector are skipped.
+ */
+uint32_t drm_resources_find_crtc(struct drm_resources *r, drmModeConnectorPtr connector,
+				uint32_t taken)
+{
+	drmModeEncoderPtr encoder = drm_resources_encoder(r, connector->encoder_id);
+	int index;
+
+	if (encoder && encoder->crtc_id) {
+		index = drm_resources_crtc_index(r, encoder->crtc_id);
+		if (index >= 0 && !(taken & (1u << index)))
+			return encoder->crtc_id;
+	}
+
+	for (int i = 0; i < connector->count_encoders; i++) {
+		encoder = drm_resources_encoder(r, connector->encoders[i]);
+		if (!encoder)
+			continue;
+
+		for (int j = 0; j < r->res->count_crtcs; j++) {
+			if (!(encoder->possible_crtcs & (1u << j)) || (taken & (1u << j)) ||
+			    crtc_in_use(r, r->res->crtcs[j], connector->connector_id))
+				continue;
+			return r->res->crtcs[j];
+		}
+	}
+
+	return 0;
+}
+
+drmModeCrtcPtr drm_resources_crtc(struct drm_resources *r, uint32_t id)
+{
+	int i = drm_resources_crtc_index(r, id);
+
+	if (i < 0)
+		return NULL;
+	if (!r->crtcs[i])
+		r->crtcs[i] = drmModeGetCrtc(r->fd, id);
+
+	return r->crtcs[i];
+}
+
+/* The caller owns the CRTC afterwards and frees it with drmModeFreeCrtc() */
+drmModeCrtcPtr drm_resources_take_crtc(struct drm_resources *r, uint32_t id)
+{
+	drmModeCrtcPtr crtc = drm_resources_crtc(r, id);
+
+	if (crtc)
+		r->crtcs[drm_resources_crtc_index(r, id)] = NULL;
+
+	return crtc;
+}
+
+/* Loads all planes including primary and cursor planes, returns their number */
+int drm_resources_load_planes(struct drm_resources *r)
+{
+	if (r->plane_res)
+		return r->plane_res->count_planes;
+
+	drmSetClientCap(r->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+
+	r->plane_res = drmModeGetPlaneResources(r->fd);
+	if (!r->plane_res) {
+		print_error("Could not get plane resources\n");
+		return -EINVAL;
+	}
+
+	r->planes = calloc(r->plane_res->count_planes, sizeof(*r->planes));
+	if (!r->planes) {
+		drmModeFreePlaneResources(r->plane_res);
+		r->plane_res = NULL;
+		return -ENOMEM;
+	}
+
+	for (uint32_t i = 0; i < r->plane_res->count_planes; i++)
+		r->planes[i] = drmModeGetPlane(r->fd, r->plane_res->planes[i]);
+
+	return r->plane_res->count_planes;
+}
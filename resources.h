@@ -0,0 +1,57 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <stdint.h>
+
+#include "drm_framebuffer.h"
+
+/*
+ * KMS objects of a device, each one fetched from the kernel at most once. Connectors are loaded
+ * up front since lookups go by name, everything else when it is first asked for. Objects stay
+ * owned by the index unless they are taken out of it.
+ */
+struct drm_resources {
+	int fd;
+	drmModeResPtr res;
+	drmModeConnectorPtr *connectors;
+	char (*names)[32];
+	drmModeEncoderPtr *encoders;
+	drmModeCrtcPtr *crtcs;
+	drmModePlaneResPtr plane_res;
+	drmModePlanePtr *planes;
+	/* Open addressing table of connector indices by name, -1 for free slots */
+	int *name_table;
+	uint32_t name_mask;
+};
+
+int drm_resources_load(int fd, struct drm_resources *r);
+void drm_resources_release(struct drm_resources *r);
+
+const char *connector_type_name(unsigned int type);
+
+int drm_resources_find_connector(struct drm_resources *r, const char *name);
+drmModeConnectorPtr drm_resources_take_connector(struct drm_resources *r, int index);
+drmModeEncoderPtr drm_resources_encoder(struct drm_resources *r, uint32_t id);
+int drm_resources_crtc_index(struct drm_resources *r, uint32_t id);
+uint32_t drm_resources_find_crtc(struct drm_resources *r, drmModeConnectorPtr connector,
+				uint32_t taken);
+drmModeCrtcPtr drm_resources_crtc(struct drm_resources *r, uint32_t id);
+drmModeCrtcPtr drm_resources_take_crtc(struct drm_resources *r, uint32_t id);
+int drm_resources_load_planes(struct drm_resources *r);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Slideshow over the images of a directory with crossfades between them. Images are decoded
+ * ahead into a small pool while the current one is on display, so a transition only blends two
+ * decoded images into the back buffer with the crossfade kernel and flips.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+#include "image.h"
+#include "kernels.h"
+#include "slideshow.h"
+
+/* Current image plus the ones decoded ahead */
+#define SLIDESHOW_POOL 3
+
+struct slideshow {
+	struct framebuffer *fb;
+	const char *dir;
+	struct dirent **files;
+	int file_count;
+	int next_file;
+	/* Display sized images, pool[head] is the one on screen */
+	uint32_t *pool[SLIDESHOW_POOL];
+	uint32_t head;
+	uint32_t filled;
+	struct dumb_buffer scanout[2];
+	uint32_t back;
+	int flip_pending;
+	/* Whether last_sequence belongs to the running crossfade and not to the hold before it */
+	int fading;
+	unsigned int last_sequence;
+	uint64_t transitions;
+	uint64_t frames;
+	uint64_t missed;
+	double cpu_total;
+	double cpu_max;
+};
+
+static double now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int image_filter(const struct dirent *entry)
+{
+	return entry->d_name[0] != '.';
+}
+
+/* Decodes the next loadable file into the pool, wrapping around at the end of the directory */
+static int decode_ahead(struct slideshow *show)
+{
+	uint32_t slot = (show->head + show->filled) % SLIDESHOW_POOL;
+
+	for (int tries = 0; tries < show->file_count; tries++) {
+		char path[4096];
+
+		snprintf(path, sizeof(path), "%s/%s", show->dir, show->files[show->next_file]->d_name);
+		show->next_file = (show->next_file + 1) % show->file_count;
+		if (!load_image(show->fb, path, show->pool[slot])) {
+			show->filled++;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+			      unsigned int tv_usec, void *user_data)
+{
+	struct slideshow *show = user_data;
+
+	/* Frames of a transition should be one vblank apart */
+	if (show->fading && sequence - show->last_sequence > 1)
+		show->missed += sequence - show->last_sequence - 1;
+
+	show->fading = 1;
+	show->last_sequence = sequence;
+	show->flip_pending = 0;
+}
+
+static int flip(struct slideshow *show, struct dumb_buffer *buf)
+{
+	struct framebuffer *fb = show->fb;
+	struct pollfd pfd = { .fd = fb->fd, .events = POLLIN };
+	drmEventContext ev = {
+		.version = 2,
+		.page_flip_handler = page_flip_handler,
+	};
+	int err;
+
+	err = master_acquire(fb);
+	if (err)
+		return err;
+	err = drmModePageFlip(fb->fd, fb->crtc->crtc_id, buf->fb_id, DRM_MODE_PAGE_FLIP_EVENT,
+			      show);
+	master_release(fb);
+
+	if (err) {
+		printf("Page flip failed (err=%d)\n", err);
+		return err;
+	}
+
+	show->flip_pending = 1;
+	while (show->flip_pending) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		drmHandleEvent(fb->fd, &ev);
+	}
+
+	return 0;
+}
+
+static int crossfade(struct slideshow *show, const uint32_t *from, const uint32_t *to,
+		     uint32_t steps)
+{
+	struct framebuffer *fb = show->fb;
+
+	show->fading = 0;
+	for (uint32_t i = 1; i <= steps; i++) {
+		struct dumb_buffer *buf = &show->scanout[show->back];
+		uint32_t weight = i * 256 / steps;
+		double cpu = now(CLOCK_THREAD_CPUTIME_ID);
+		int err;
+
+		for (uint32_t y = 0; y < fb->res_y; y++)
+			kernels.crossfade((uint32_t *)&buf->data[y * buf->pitch],
+					  &from[(size_t)y * fb->res_x], &to[(size_t)y * fb->res_x],
+					  fb->res_x, weight);
+
+		cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+		show->cpu_total += cpu;
+		if (cpu > show->cpu_max)
+			show->cpu_max = cpu;
+
+		err = flip(show, buf);
+		if (err)
+			return err;
+
+		show->frames++;
+		show->back ^= 1;
+	}
+
+	show->transitions++;
+
+	return 0;
+}
+
+/* Sleeps until the deadline unless a signal asks to terminate */
+static void sleep_until(double deadline)
+{
+	double left;
+
+	while (!terminate && (left = deadline - now(CLOCK_MONOTONIC)) > 0) {
+		struct timespec ts = {
+			.tv_sec = (time_t)left,
+			.tv_nsec = (long)((left - (time_t)left) * 1e9),
+		};
+
+		nanosleep(&ts, NULL);
+	}
+}
+
+int run_slideshow(struct framebuffer *fb, const char *dir, uint32_t hold_ms, uint32_t fade_ms)
+{
+	struct slideshow show;
+	uint32_t refresh = fb->resolution->vrefresh ? fb->resolution->vrefresh : 60;
+	uint32_t steps = (uint64_t)fade_ms * refresh / 1000;
+	size_t frame_size = (size_t)fb->res_x * fb->res_y * 4;
+	int err = 0;
+
+	memset(&show, 0, sizeof(show));
+	show.fb = fb;
+	show.dir = dir;
+
+	show.file_count = scandir(dir, &show.files, image_filter, alphasort);
+	if (show.file_count <= 0) {
+		printf("No images in %s\n", dir);
+		return -ENOENT;
+	}
+
+	for (uint32_t i = 0; i < SLIDESHOW_POOL; i++) {
+		show.pool[i] = malloc(frame_size);
+		if (!show.pool[i]) {
+			err = -ENOMEM;
+			goto cleanup;
+		}
+	}
+
+	for (uint32_t i = 0; i < 2; i++) {
+		err = create_dumb_buffer(fb->fd, fb->res_x, fb->res_y, DRM_FORMAT_XRGB8888,
+					 &show.scanout[i]);
+		if (err)
+			goto cleanup;
+	}
+
+	err = decode_ahead(&show);
+	if (err) {
+		printf("None of the files in %s could be loaded\n", dir);
+		goto cleanup;
+	}
+
+	for (uint32_t y = 0; y < fb->res_y; y++)
+		memcpy(&show.scanout[0].data[y * show.scanout[0].pitch],
+		       &show.pool[0][(size_t)y * fb->res_x], fb->res_x * 4);
+
+	err = scanout_framebuffer(fb, show.scanout[0].fb_id, 0, 0);
+	if (err)
+		goto cleanup;
+	show.back = 1;
+
+	print_verbose("Showing each image for %u ms, crossfades take %u frames at %u Hz\n",
+		      hold_ms, steps, refresh);
+
+	catch_termination();
+
+	while (!terminate) {
+		double deadline = now(CLOCK_MONOTONIC) + hold_ms / 1000.0;
+		const uint32_t *from, *to;
+
+		/* Decoding happens while the current image is on display */
+		while (show.filled < SLIDESHOW_POOL && !terminate && !decode_ahead(&show))
+			;
+		sleep_until(deadline);
+		if (terminate)
+			break;
+		/* Files disappeared, keep the current image and try again later */
+		if (show.filled < 2)
+			continue;
+
+		from = show.pool[show.head];
+		show.head = (show.head + 1) % SLIDESHOW_POOL;
+		show.filled--;
+		to = show.pool[show.head];
+
+		if (steps) {
+			err = crossfade(&show, from, to, steps);
+		} else {
+			struct dumb_buffer *buf = &show.scanout[show.back];
+
+			for (uint32_t y = 0; y < fb->res_y; y++)
+				memcpy(&buf->data[y * buf->pitch], &to[(size_t)y * fb->res_x],
+				       fb->res_x * 4);
+			err = flip(&show, buf);
+			show.back ^= 1;
+		}
+		if (err)
+			break;
+	}
+
+	if (show.frames)
+		printf("%lu transitions, %lu frames, CPU per frame %.2f ms average, %.2f ms max, "
+		       "%lu missed vblanks\n",
+		       (unsigned long)show.transitions, (unsigned long)show.frames,
+		       show.cpu_total * 1000 / show.frames, show.cpu_max * 1000,
+		       (unsigned long)show.missed);
+
+	/* Don't pull the images away while one of them is scanned out */
+	scanout_framebuffer(fb, fb->buffer_id, fb->pan_x, fb->pan_y);
+
+cleanup:
+	for (uint32_t i = 0; i < 2; i++)
+		destroy_dumb_buffer(fb->fd, &show.scanout[i]);
+	for (uint32_t i = 0; i < SLIDESHOW_POOL; i++)
+		free(show.pool[i]);
+	for (int i = 0; i < show.file_count; i++)
+		free(show.files[i]);
+	free(show.files);
+
+	return err;
+}
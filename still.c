@@ -0,0 +1,442 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Still image described by a config file, which is reloaded on SIGHUP. A reload only does what
+ * the change needs: a new image is flipped to, a new format gets new buffers and only a new mode
+ * causes a modeset. Nothing is released while the process runs.
+ *
+ * Hotplug events re-probe the connector. A monitor which comes back gets a modeset with its
+ * preferred mode, the buffers are kept if the size didn't change.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+#include "config.h"
+#include "image.h"
+#include "kernels.h"
+#include "hotplug.h"
+#include "still.h"
+
+extern char _picture_start[];
+extern char _picture_end[];
+
+struct still {
+	struct framebuffer *fb;
+	const char *config_path;
+	struct display_config config;
+	drmModeModeInfoPtr preferred;
+	/* Width of the built-in picture, which has the size of the mode at startup */
+	uint16_t picture_x;
+	int hotplug;
+	int minor;
+	int connected;
+	/* Display sized image in XRGB8888, converted when written to the scanout buffers */
+	uint32_t *image;
+	struct dumb_buffer scanout[2];
+	uint32_t format;
+	uint32_t back;
+	int flip_pending;
+};
+
+static volatile sig_atomic_t reload_requested;
+static volatile sig_atomic_t probe_requested;
+
+static void handle_reload(int sig)
+{
+	reload_requested = 1;
+}
+
+static void handle_probe(int sig)
+{
+	probe_requested = 1;
+}
+
+static drmModeModeInfoPtr find_mode(struct still *still, const struct display_config *config)
+{
+	drmModeConnectorPtr connector = still->fb->connector;
+
+	if (!config->mode_x)
+		return still->preferred;
+
+	for (int i = 0; i < connector->count_modes; i++) {
+		drmModeModeInfoPtr mode = &connector->modes[i];
+
+		if (mode->hdisplay == config->mode_x && mode->vdisplay == config->mode_y &&
+		    (!config->refresh || mode->vrefresh == config->refresh))
+			return mode;
+	}
+
+	printf("Connector has no mode %ux%u", config->mode_x, config->mode_y);
+	if (config->refresh)
+		printf("@%u", config->refresh);
+	printf("\n");
+
+	return NULL;
+}
+
+static void write_buffer(struct still *still, struct dumb_buffer *buf, uint32_t format)
+{
+	struct framebuffer *fb = still->fb;
+
+	for (uint32_t y = 0; y < fb->res_y; y++) {
+		const uint32_t *src = &still->image[(size_t)y * fb->res_x];
+
+		if (format == DRM_FORMAT_RGB565)
+			kernels.convert((uint16_t *)&buf->data[y * buf->pitch], src, fb->res_x);
+		else
+			kernels.copy(&buf->data[y * buf->pitch], src, fb->res_x * 4);
+	}
+}
+
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+			      unsigned int tv_usec, void *user_data)
+{
+	struct still *still = user_data;
+
+	still->flip_pending = 0;
+}
+
+static int flip(struct still *still, struct dumb_buffer *buf)
+{
+	struct framebuffer *fb = still->fb;
+	struct pollfd pfd = { .fd = fb->fd, .events = POLLIN };
+	drmEventContext ev = {
+		.version = 2,
+		.page_flip_handler = page_flip_handler,
+	};
+	int err;
+
+	err = master_acquire(fb);
+	if (err)
+		return err;
+	err = drmModePageFlip(fb->fd, fb->crtc->crtc_id, buf->fb_id, DRM_MODE_PAGE_FLIP_EVENT,
+			      still);
+	master_release(fb);
+
+	if (err) {
+		printf("Page flip failed (err=%d)\n", err);
+		return err;
+	}
+
+	still->flip_pending = 1;
+	while (still->flip_pending) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		drmHandleEvent(fb->fd, &ev);
+	}
+
+	return 0;
+}
+
+static int modeset(struct still *still, struct dumb_buffer *buf, drmModeModeInfoPtr mode)
+{
+	struct framebuffer *fb = still->fb;
+	int err;
+
+	err = master_acquire(fb);
+	if (err)
+		return err;
+	err = drmModeSetCrtc(fb->fd, fb->crtc->crtc_id, buf->fb_id, 0, 0,
+			     &fb->connector->connector_id, 1, mode);
+	master_release(fb);
+
+	if (err)
+		printf("Could not set mode %s (err=%d)\n", mode->name, err);
+
+	return err;
+}
+
+static int load(struct still *still, const struct display_config *config, uint32_t *image)
+{
+	struct framebuffer *fb = still->fb;
+	uint32_t width = still->picture_x;
+	uint32_t height = (_picture_end - _picture_start) / (width * 4);
+
+	if (config->image[0])
+		return load_image_scaled(fb, config->image, image, config->scale);
+
+	/* The built-in picture has the size of the mode at startup */
+	if (!height)
+		return -EINVAL;
+	place_image(fb, image, (const uint32_t *)_picture_start, width, height, config->scale);
+
+	return 0;
+}
+
+/* Shows the configuration with as few KMS operations as possible, keeps the old one on errors */
+static int apply(struct still *still, const struct display_config *config, int force_modeset)
+{
+	struct framebuffer *fb = still->fb;
+	drmModeModeInfoPtr old_mode = fb->resolution, mode;
+	struct dumb_buffer fresh[2], *target;
+	uint32_t *image = still->image;
+	int new_mode, new_buffers;
+	int err;
+
+	mode = find_mode(still, config);
+	if (!mode)
+		return -EINVAL;
+
+	new_mode = force_modeset || mode != old_mode;
+	new_buffers = !still->image || mode->hdisplay != fb->res_x || mode->vdisplay != fb->res_y ||
+		      config->format != still->format;
+
+	memset(fresh, 0, sizeof(fresh));
+	fb->resolution = mode;
+	fb->res_x = mode->hdisplay;
+	fb->res_y = mode->vdisplay;
+
+	if (new_buffers) {
+		image = calloc((size_t)fb->res_x * fb->res_y, 4);
+		if (!image) {
+			err = -ENOMEM;
+			goto error;
+		}
+		for (uint32_t i = 0; i < 2; i++) {
+			err = create_dumb_buffer(fb->fd, fb->res_x, fb->res_y, config->format,
+						 &fresh[i]);
+			if (err)
+				goto error;
+		}
+		target = &fresh[0];
+	} else {
+		target = &still->scanout[still->back];
+	}
+
+	err = load(still, config, image);
+	if (err)
+		goto error;
+	write_buffer(still, target, config->format);
+
+	if (new_mode)
+		err = modeset(still, target, mode);
+	else if (new_buffers)
+		err = scanout_framebuffer(fb, target->fb_id, 0, 0);
+	else
+		err = flip(still, target);
+	if (err)
+		goto error;
+
+	print_verbose("Showing %s as %ux%u@%u, %s\n",
+		      config->image[0] ? config->image : "built-in picture", fb->res_x, fb->res_y,
+		      mode->vrefresh,
+		      new_mode ? "modeset" : new_buffers ? "new buffers" : "page flip");
+
+	if (new_buffers) {
+		for (uint32_t i = 0; i < 2; i++) {
+			destroy_dumb_buffer(fb->fd, &still->scanout[i]);
+			still->scanout[i] = fresh[i];
+		}
+		free(still->image);
+		still->image = image;
+		still->format = config->format;
+		still->back = 1;
+	} else {
+		still->back ^= 1;
+	}
+	still->config = *config;
+
+	return 0;
+
+error:
+	if (new_buffers) {
+		for (uint32_t i = 0; i < 2; i++)
+			destroy_dumb_buffer(fb->fd, &fresh[i]);
+		free(image);
+	}
+	fb->resolution = old_mode;
+	fb->res_x = old_mode->hdisplay;
+	fb->res_y = old_mode->vdisplay;
+
+	return err;
+}
+
+static drmModeModeInfoPtr preferred_mode(drmModeConnectorPtr connector)
+{
+	for (int i = 0; i < connector->count_modes; i++) {
+		if (connector->modes[i].type & DRM_MODE_TYPE_PREFERRED)
+			return &connector->modes[i];
+	}
+
+	return connector->count_modes ? &connector->modes[0] : NULL;
+}
+
+/* Probes our connector again and shows the current configuration on what is plugged in now */
+static int reprobe(struct still *still)
+{
+	struct framebuffer *fb = still->fb;
+	drmModeConnectorPtr old = fb->connector, connector;
+	drmModeModeInfoPtr old_preferred = still->preferred;
+	int err;
+
+	connector = drmModeGetConnector(fb->fd, old->connector_id);
+	if (!connector) {
+		printf("Could not probe connector %u\n", old->connector_id);
+		return -EINVAL;
+	}
+
+	if (connector->connection != DRM_MODE_CONNECTED || !preferred_mode(connector)) {
+		if (still->connected)
+			print_verbose("Connector %u disconnected\n", connector->connector_id);
+		still->connected = 0;
+		drmModeFreeConnector(connector);
+		return 0;
+	}
+
+	print_verbose("Connector %u connected\n", connector->connector_id);
+	still->connected = 1;
+
+	/* The old modes stay valid until the new ones are on the display */
+	fb->connector = connector;
+	still->preferred = preferred_mode(connector);
+
+	err = apply(still, &still->config, 1);
+	if (err && still->config.mode_x) {
+		struct display_config config = still->config;
+
+		/* The requested mode may be gone with the old monitor */
+		config.mode_x = 0;
+		config.mode_y = 0;
+		err = apply(still, &config, 1);
+	}
+	if (err) {
+		fb->connector = old;
+		still->preferred = old_preferred;
+		drmModeFreeConnector(connector);
+		return err;
+	}
+
+	drmModeFreeConnector(old);
+
+	return 0;
+}
+
+static void handle_hotplug(struct still *still)
+{
+	struct hotplug_event event;
+	int changed = 0;
+
+	/* Replugging sends a burst of events, probe once for all of them */
+	while (hotplug_read(still->hotplug, &event) > 0) {
+		if ((event.minor < 0 || event.minor == still->minor) &&
+		    (!event.connector_id || event.connector_id == still->fb->connector->connector_id))
+			changed = 1;
+	}
+
+	if (changed)
+		reprobe(still);
+}
+
+int run_still(struct framebuffer *fb, const char *config_path)
+{
+	struct still still;
+	struct display_config config;
+	struct sigaction sa;
+	struct stat st;
+	sigset_t block, wait_mask;
+	int err;
+
+	memset(&still, 0, sizeof(still));
+	still.fb = fb;
+	still.config_path = config_path;
+	still.preferred = fb->resolution;
+	still.picture_x = fb->res_x;
+	still.connected = 1;
+	still.minor = fstat(fb->fd, &st) ? -1 : (int)minor(st.st_rdev);
+
+	/* Without hotplug events the display just isn't restored after a replug */
+	still.hotplug = hotplug_open();
+
+	err = config_load(config_path, &config);
+	if (!err)
+		err = apply(&still, &config, 1);
+	if (err)
+		goto cleanup;
+
+	/* Signals are only delivered while waiting, so no reload is missed between the checks */
+	sigemptyset(&block);
+	sigaddset(&block, SIGHUP);
+	sigaddset(&block, SIGUSR1);
+	sigaddset(&block, SIGTERM);
+	sigaddset(&block, SIGINT);
+	sigprocmask(SIG_BLOCK, &block, &wait_mask);
+
+	catch_termination();
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_reload;
+	sigaction(SIGHUP, &sa, NULL);
+	sa.sa_handler = handle_probe;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	while (!terminate) {
+		struct pollfd pfd = { .fd = still.hotplug, .events = POLLIN };
+
+		if (reload_requested) {
+			reload_requested = 0;
+			print_verbose("Reloading %s\n", config_path);
+			if (config_load(config_path, &config))
+				continue;
+			/* Without a monitor the config is only applied once one is plugged in */
+			if (!still.connected)
+				still.config = config;
+			else if (apply(&still, &config, 0))
+				printf("Keeping the previous configuration\n");
+			continue;
+		}
+		/* Same as a hotplug event, for testing without touching cables */
+		if (probe_requested) {
+			probe_requested = 0;
+			reprobe(&still);
+			continue;
+		}
+
+		if (ppoll(&pfd, still.hotplug >= 0, NULL, &wait_mask) > 0)
+			handle_hotplug(&still);
+	}
+
+	sigprocmask(SIG_SETMASK, &wait_mask, NULL);
+
+	/* Back to the original mode and buffer before ours are destroyed */
+	fb->resolution = still.preferred;
+	fb->res_x = still.preferred->hdisplay;
+	fb->res_y = still.preferred->vdisplay;
+	scanout_framebuffer(fb, fb->buffer_id, fb->pan_x, fb->pan_y);
+
+cleanup:
+	for (uint32_t i = 0; i < 2; i++)
+		destroy_dumb_buffer(fb->fd, &still.scanout[i]);
+	free(still.image);
+	if (still.hotplug >= 0)
+		close(still.hotplug);
+
+	return err;
+}
@@ -0,0 +1,481 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Stream mode reads commands from stdin, or from clients on a Unix socket when it runs as a
+ * daemon. Every command is a single text line, some of them are followed by binary pixel data:
+ *
+ *   frame                          XRGB8888 pixels for the background, the size of the buffer or
+ *                                  the input size given in the options
+ *   surface <id> <x> <y> <w> <h>   w * h premultiplied ARGB8888 pixels, creates or updates it
+ *   move <id> <x> <y>              move a surface
+ *   remove <id>                    remove a surface
+ *   cursor <w> <h> <hot_x> <hot_y> w * h premultiplied ARGB8888 pixels for the cursor sprite
+ *   cursor_move <x> <y>            move the hotspot of the cursor to x/y
+ *   cursor_hide                    hide the cursor
+ *   pan <x> <y>                    show the part of the buffer starting at x/y
+ *   crop <x> <y>                   show the part of the input frames starting at x/y
+ *   image <path>                   load a QOI or raw image file into the visible area
+ *
+ * Empty lines and lines starting with # are ignored. The display is updated after every command.
+ * Socket clients get a reply line for every command, "ok" or "error <errno>". The display state
+ * stays between clients, so an update costs one round trip and a copy.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "drm_framebuffer.h"
+#include "compose.h"
+#include "cursor.h"
+#include "fcache.h"
+#include "kernels.h"
+#include "blit.h"
+#include "image.h"
+#include "stream.h"
+
+#define MAX_SURFACE_SIZE 8192
+
+struct stream {
+	struct compositor comp;
+	struct cursor cursor;
+	struct stream_options options;
+	/* Whole input frame if it can't be scanned out directly */
+	uint32_t *input;
+	struct frame_cache cache;
+	/* Where commands and their pixel data come from */
+	FILE *in;
+};
+
+static int read_payload(struct stream *stream, void *data, size_t size)
+{
+	if (fread(data, 1, size, stream->in) != size) {
+		if (!terminate)
+			printf("Stream ended in the middle of a command\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* Copy the visible window of the input frame, frames exceeding the buffer are never copied whole */
+static void blit_window(struct stream *stream)
+{
+	struct compositor *comp = &stream->comp;
+	struct framebuffer *fb = comp->fb;
+	struct stream_options *opt = &stream->options;
+	uint32_t w = opt->input_x - opt->crop_x;
+	uint32_t h = opt->input_y - opt->crop_y;
+
+	if (w > fb->virt_x)
+		w = fb->virt_x;
+	if (h > fb->virt_y)
+		h = fb->virt_y;
+
+	for (uint32_t y = 0; y < h; y++)
+		kernels.copy(&comp->background[y * fb->virt_x],
+			     &stream->input[(opt->crop_y + y) * opt->input_x + opt->crop_x], w * 4);
+
+	compositor_damage(comp, 0, 0, w, h);
+}
+
+static int set_crop(struct stream *stream, uint32_t x, uint32_t y)
+{
+	struct framebuffer *fb = stream->comp.fb;
+	struct stream_options *opt = &stream->options;
+
+	/* Frames which fit into the buffer are cropped by the display hardware */
+	if (!stream->input)
+		return compositor_pan(&stream->comp, x > UINT16_MAX ? UINT16_MAX : x,
+				      y > UINT16_MAX ? UINT16_MAX : y);
+
+	opt->crop_x = opt->input_x > fb->virt_x ? opt->input_x - fb->virt_x : 0;
+	opt->crop_y = opt->input_y > fb->virt_y ? opt->input_y - fb->virt_y : 0;
+	if (x < opt->crop_x)
+		opt->crop_x = x;
+	if (y < opt->crop_y)
+		opt->crop_y = y;
+
+	blit_window(stream);
+
+	return compositor_present(&stream->comp);
+}
+
+/* Show a frame from the cache if it was sent before, else put it into the cache */
+static int present_cached(struct stream *stream)
+{
+	struct compositor *comp = &stream->comp;
+	struct framebuffer *fb = comp->fb;
+	size_t size = (size_t)fb->virt_x * fb->virt_y * 4;
+	uint64_t hash = kernels.hash(comp->background, size);
+	struct dumb_buffer *buf;
+
+	buf = frame_cache_lookup(&stream->cache, hash);
+	if (!buf) {
+		buf = frame_cache_insert(&stream->cache, hash);
+		if (!buf)
+			return compositor_present(comp);
+
+		blit(buf->data, buf->pitch, (const uint8_t *)comp->background, fb->virt_x * 4,
+		     fb->virt_x * 4, fb->virt_y);
+	}
+
+	return compositor_show_buffer(comp, buf->fb_id);
+}
+
+static int handle_cursor(struct stream *stream, const char *line)
+{
+	uint32_t *pixels;
+	uint32_t w, h;
+	int32_t hot_x, hot_y;
+	int err;
+
+	if (sscanf(line, "%*s %u %u %d %d", &w, &h, &hot_x, &hot_y) != 4 || !w || !h ||
+	    w > MAX_SURFACE_SIZE || h > MAX_SURFACE_SIZE) {
+		printf("Invalid cursor command: %s", line);
+		return -EINVAL;
+	}
+
+	pixels = malloc((size_t)w * h * 4);
+	if (!pixels)
+		return -ENOMEM;
+
+	err = read_payload(stream, pixels, (size_t)w * h * 4);
+	if (!err)
+		err = cursor_set_image(&stream->cursor, pixels, w, h, hot_x, hot_y);
+
+	free(pixels);
+
+	return err;
+}
+
+static int handle_image(struct stream *stream, const char *line)
+{
+	struct compositor *comp = &stream->comp;
+	struct framebuffer *fb = comp->fb;
+	char path[256];
+	int err;
+
+	if (sscanf(line, "%*s %255[^\r\n]", path) != 1) {
+		printf("Invalid image command: %s", line);
+		return -EINVAL;
+	}
+
+	/* Decoded straight into the visible part of the background */
+	err = load_image_to(fb, path,
+			    (uint8_t *)&comp->background[fb->pan_y * fb->virt_x + fb->pan_x],
+			    fb->virt_x * 4, IMAGE_CENTER);
+	compositor_damage(comp, fb->pan_x, fb->pan_y, fb->res_x, fb->res_y);
+	if (err)
+		return err;
+	if (stream->cache.count && !compositor_cpu_surfaces(comp))
+		return present_cached(stream);
+
+	return compositor_present(comp);
+}
+
+static int handle_command(struct stream *stream, const char *line)
+{
+	struct compositor *comp = &stream->comp;
+	struct framebuffer *fb = comp->fb;
+	struct surface *s;
+	char cmd[16];
+	uint32_t id, w, h;
+	int32_t x, y;
+	int err;
+
+	if (sscanf(line, "%15s", cmd) != 1 || cmd[0] == '#')
+		return 0;
+
+	if (strcmp(cmd, "frame") == 0) {
+		if (stream->input) {
+			err = read_payload(stream, stream->input,
+					   (size_t)stream->options.input_x * stream->options.input_y * 4);
+			if (err)
+				return err;
+			blit_window(stream);
+		} else {
+			err = read_payload(stream, comp->background,
+					   (size_t)fb->virt_x * fb->virt_y * 4);
+			if (err)
+				return err;
+			compositor_damage(comp, 0, 0, fb->virt_x, fb->virt_y);
+		}
+
+		/* Cached frames can't be composed into, so only use them without CPU surfaces */
+		if (stream->cache.count && !compositor_cpu_surfaces(comp))
+			return present_cached(stream);
+	} else if (strcmp(cmd, "surface") == 0) {
+		if (sscanf(line, "%*s %u %d %d %u %u", &id, &x, &y, &w, &h) != 5 || !w || !h ||
+		    w > MAX_SURFACE_SIZE || h > MAX_SURFACE_SIZE) {
+			printf("Invalid surface command: %s", line);
+			return -EINVAL;
+		}
+
+		s = compositor_get_surface(comp, id, w, h);
+		if (!s)
+			return -ENOMEM;
+
+		err = read_payload(stream, s->pixels, (size_t)w * h * 4);
+		if (err)
+			return err;
+		compositor_move_surface(comp, s, x, y);
+	} else if (strcmp(cmd, "move") == 0) {
+		if (sscanf(line, "%*s %u %d %d", &id, &x, &y) != 3) {
+			printf("Invalid move command: %s", line);
+			return -EINVAL;
+		}
+
+		s = compositor_find_surface(comp, id);
+		if (s)
+			compositor_move_surface(comp, s, x, y);
+	} else if (strcmp(cmd, "remove") == 0) {
+		if (sscanf(line, "%*s %u", &id) != 1) {
+			printf("Invalid remove command: %s", line);
+			return -EINVAL;
+		}
+
+		compositor_remove_surface(comp, id);
+	} else if (strcmp(cmd, "cursor") == 0) {
+		/* The cursor is updated on its own, the composition doesn't change */
+		return handle_cursor(stream, line);
+	} else if (strcmp(cmd, "cursor_move") == 0) {
+		if (sscanf(line, "%*s %d %d", &x, &y) != 2) {
+			printf("Invalid cursor_move command: %s", line);
+			return -EINVAL;
+		}
+
+		return cursor_move(&stream->cursor, x, y);
+	} else if (strcmp(cmd, "cursor_hide") == 0) {
+		return cursor_hide(&stream->cursor);
+	} else if (strcmp(cmd, "pan") == 0) {
+		if (sscanf(line, "%*s %d %d", &x, &y) != 2 || x < 0 || y < 0) {
+			printf("Invalid pan command: %s", line);
+			return -EINVAL;
+		}
+
+		err = compositor_pan(comp, x > UINT16_MAX ? UINT16_MAX : x,
+				     y > UINT16_MAX ? UINT16_MAX : y);
+		if (err || stream->cursor.mode != CURSOR_COMPOSED)
+			return err;
+
+		/* Keep a composed cursor at its position on the screen */
+		return cursor_move(&stream->cursor, stream->cursor.x, stream->cursor.y);
+	} else if (strcmp(cmd, "crop") == 0) {
+		if (sscanf(line, "%*s %d %d", &x, &y) != 2 || x < 0 || y < 0) {
+			printf("Invalid crop command: %s", line);
+			return -EINVAL;
+		}
+
+		return set_crop(stream, x, y);
+	} else if (strcmp(cmd, "image") == 0) {
+		return handle_image(stream, line);
+	} else {
+		printf("Unknown stream command %s\n", cmd);
+		return -EINVAL;
+	}
+
+	return compositor_present(comp);
+}
+
+static int stream_setup(struct stream *stream, struct framebuffer *fb,
+			const struct stream_options *options)
+{
+	int err;
+
+	memset(stream, 0, sizeof(*stream));
+	stream->options = *options;
+
+	if (!stream->options.input_x || !stream->options.input_y) {
+		stream->options.input_x = fb->virt_x;
+		stream->options.input_y = fb->virt_y;
+	}
+
+	if (stream->options.input_x != fb->virt_x || stream->options.input_y != fb->virt_y) {
+		stream->input = calloc((size_t)stream->options.input_x * stream->options.input_y, 4);
+		if (!stream->input)
+			return -ENOMEM;
+		print_verbose("Copying a %ux%u window of %ux%u frames\n", fb->virt_x, fb->virt_y,
+			      stream->options.input_x, stream->options.input_y);
+	}
+
+	err = show_framebuffer(fb);
+	if (!err)
+		err = compositor_init(&stream->comp, fb);
+	if (err) {
+		free(stream->input);
+		return err;
+	}
+
+	cursor_init(&stream->cursor, &stream->comp);
+
+	if (stream->options.cache_budget)
+		frame_cache_init(&stream->cache, fb->fd, fb->virt_x, fb->virt_y,
+				 stream->options.cache_budget);
+
+	if (stream->options.crop_x || stream->options.crop_y)
+		set_crop(stream, stream->options.crop_x, stream->options.crop_y);
+
+	catch_termination();
+
+	return 0;
+}
+
+static void stream_teardown(struct stream *stream)
+{
+	struct framebuffer *fb = stream->comp.fb;
+
+	/* Go back to the framebuffer's own buffer before the cached ones are destroyed */
+	if (stream->comp.shown_id != fb->buffer_id) {
+		compositor_damage(&stream->comp, 0, 0, fb->virt_x, fb->virt_y);
+		compositor_present(&stream->comp);
+	}
+	frame_cache_release(&stream->cache);
+
+	cursor_release(&stream->cursor);
+	compositor_release(&stream->comp);
+	free(stream->input);
+}
+
+int run_stream(struct framebuffer *fb, const struct stream_options *options)
+{
+	struct stream stream;
+	char line[256];
+	int err;
+
+	err = stream_setup(&stream, fb, options);
+	if (err)
+		return err;
+	stream.in = stdin;
+
+	print_verbose("Reading stream from stdin\n");
+
+	while (!terminate && fgets(line, sizeof(line), stdin)) {
+		err = handle_command(&stream, line);
+		if (err)
+			break;
+	}
+
+	/* Keep the last frame on the display like in picture mode */
+	if (!err && !terminate)
+		wait_for_termination();
+
+	stream_teardown(&stream);
+
+	return terminate ? 0 : err;
+}
+
+static int open_listener(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	int sock;
+	int err;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long\n", socket_path);
+		return -EINVAL;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	unlink(socket_path);
+	/* Only the owner may connect, nobody can before listen() so the mode is set in time */
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || chmod(socket_path, 0600) ||
+	    listen(sock, 8)) {
+		err = -errno;
+		printf("Could not listen on %s (err=%d)\n", socket_path, err);
+		close(sock);
+		return err;
+	}
+
+	return sock;
+}
+
+/* Commands of one client until it hangs up, a broken payload ends the connection */
+static void serve_client(struct stream *stream, int sock)
+{
+	char line[256];
+	int err;
+
+	stream->in = fdopen(sock, "r");
+	if (!stream->in) {
+		close(sock);
+		return;
+	}
+
+	while (!terminate && fgets(line, sizeof(line), stream->in)) {
+		char reply[32];
+
+		err = handle_command(stream, line);
+		snprintf(reply, sizeof(reply), err ? "error %d\n" : "ok\n", -err);
+		if (send(sock, reply, strlen(reply), MSG_NOSIGNAL) < 0 || err == -EIO)
+			break;
+	}
+
+	fclose(stream->in);
+	stream->in = NULL;
+}
+
+int run_stream_server(struct framebuffer *fb, const struct stream_options *options,
+		      const char *socket_path)
+{
+	struct stream stream;
+	int listener;
+	int err;
+
+	listener = open_listener(socket_path);
+	if (listener < 0)
+		return listener;
+
+	err = stream_setup(&stream, fb, options);
+	if (err) {
+		close(listener);
+		unlink(socket_path);
+		return err;
+	}
+
+	print_verbose("Waiting for clients on %s\n", socket_path);
+
+	/* One client at a time, the others wait in the backlog */
+	while (!terminate) {
+		int sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+
+		if (sock < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			err = -errno;
+			break;
+		}
+		serve_client(&stream, sock);
+	}
+
+	stream_teardown(&stream);
+	close(listener);
+	unlink(socket_path);
+
+	return terminate ? 0 : err;
+}
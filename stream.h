@@ -0,0 +1,37 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "drm_framebuffer.h"
+
+struct stream_options {
+	/* Size of the frames, 0 for the size of the buffer */
+	uint32_t input_x;
+	uint32_t input_y;
+	/* Start of the visible window inside the frames */
+	uint32_t crop_x;
+	uint32_t crop_y;
+	/* Bytes of scanout memory for the frame cache, 0 disables it */
+	uint64_t cache_budget;
+};
+
+int run_stream(struct framebuffer *fb, const struct stream_options *options);
+int run_stream_server(struct framebuffer *fb, const struct stream_options *options,
+		      const char *socket_path);
+
+#endif
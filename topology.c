@@ -0,0 +1,165 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Cache of the resolved output, so a boot splash doesn't enumerate and probe every connector. The
+ * file holds the connector and CRTC ids and the mode which were found last time, together with a
+ * hash of the monitor's EDID. Restoring it costs three ioctls on the cached connector instead of
+ * one per connector, and anything which doesn't match sends the caller back to the full search.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "drm_framebuffer.h"
+#include "fcache.h"
+#include "topology.h"
+
+#define TOPOLOGY_MAGIC 0x64726d74
+#define TOPOLOGY_VERSION 1
+
+struct topology {
+	uint32_t magic;
+	uint32_t version;
+	char device[64];
+	char connector[32];
+	uint64_t edid_hash;
+	uint32_t connector_id;
+	uint32_t crtc_id;
+	uint32_t crtc_index;
+	drmModeModeInfo mode;
+};
+
+/* Hash of the EDID property of the connector, 0 if it has none */
+static uint64_t edid_hash(int fd, uint32_t connector_id)
+{
+	drmModeObjectPropertiesPtr props;
+	uint64_t hash = 0;
+
+	props = drmModeObjectGetProperties(fd, connector_id, DRM_MODE_OBJECT_CONNECTOR);
+	if (!props)
+		return 0;
+
+	for (uint32_t i = 0; i < props->count_props && !hash; i++) {
+		drmModePropertyPtr prop = drmModeGetProperty(fd, props->props[i]);
+		drmModePropertyBlobPtr blob;
+
+		if (!prop)
+			continue;
+
+		if (strcmp(prop->name, "EDID") == 0 && props->prop_values[i]) {
+			blob = drmModeGetPropertyBlob(fd, props->prop_values[i]);
+			if (blob) {
+				hash = hash_frame(blob->data, blob->length);
+				drmModeFreePropertyBlob(blob);
+			}
+		}
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return hash;
+}
+
+int topology_restore(const char *path, const char *device, const char *connector_name,
+		     struct framebuffer *fb)
+{
+	struct topology topo;
+	drmModeConnectorPtr connector;
+	FILE *file;
+	int found;
+
+	file = fopen(path, "rb");
+	if (!file)
+		return -ENOENT;
+	found = fread(&topo, sizeof(topo), 1, file) == 1;
+	fclose(file);
+
+	if (!found || topo.magic != TOPOLOGY_MAGIC || topo.version != TOPOLOGY_VERSION ||
+	    strncmp(topo.device, device, sizeof(topo.device)) ||
+	    strncmp(topo.connector, connector_name, sizeof(topo.connector)))
+		return -EINVAL;
+
+	/* The current state only, probing is what we want to avoid */
+	connector = drmModeGetConnectorCurrent(fb->fd, topo.connector_id);
+	if (!connector)
+		return -EINVAL;
+
+	if (connector->connection != DRM_MODE_CONNECTED ||
+	    edid_hash(fb->fd, topo.connector_id) != topo.edid_hash)
+		goto mismatch;
+
+	for (int i = 0; i < connector->count_modes; i++) {
+		if (memcmp(&connector->modes[i], &topo.mode, sizeof(topo.mode)) == 0)
+			fb->resolution = &connector->modes[i];
+	}
+	if (!fb->resolution)
+		goto mismatch;
+
+	fb->crtc = drmModeGetCrtc(fb->fd, topo.crtc_id);
+	if (!fb->crtc)
+		goto mismatch;
+
+	fb->connector = connector;
+	fb->crtc_index = topo.crtc_index;
+	print_verbose("Using the cached output %s of %s\n", connector_name, device);
+
+	return 0;
+
+mismatch:
+	print_verbose("Cached output of %s is outdated\n", connector_name);
+	fb->resolution = NULL;
+	drmModeFreeConnector(connector);
+
+	return -EINVAL;
+}
+
+/* Written to a temporary file first, a crash never leaves a half written cache behind */
+int topology_store(const char *path, const char *device, const char *connector_name,
+		   const struct framebuffer *fb)
+{
+	struct topology topo;
+	char tmp[4096];
+	FILE *file;
+	int ok;
+
+	memset(&topo, 0, sizeof(topo));
+	topo.magic = TOPOLOGY_MAGIC;
+	topo.version = TOPOLOGY_VERSION;
+	snprintf(topo.device, sizeof(topo.device), "%s", device);
+	snprintf(topo.connector, sizeof(topo.connector), "%s", connector_name);
+	topo.edid_hash = edid_hash(fb->fd, fb->connector->connector_id);
+	topo.connector_id = fb->connector->connector_id;
+	topo.crtc_id = fb->crtc->crtc_id;
+	topo.crtc_index = fb->crtc_index;
+	topo.mode = *fb->resolution;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	file = fopen(tmp, "wb");
+	if (!file) {
+		print_verbose("Could not write output cache %s\n", tmp);
+		return -errno;
+	}
+	ok = fwrite(&topo, sizeof(topo), 1, file) == 1;
+	if (fclose(file) || !ok || rename(tmp, path)) {
+		print_verbose("Could not write output cache %s\n", path);
+		remove(tmp);
+		return -EIO;
+	}
+
+	return 0;
+}
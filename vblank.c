@@ -0,0 +1,274 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Refresh timing. Every vblank of the CRTC is waited for with drmWaitVBlank() and its timestamp is
+ * taken from drmCrtcGetSequence(), which reports it in ns, or from the us of the wait reply on
+ * kernels without it. Intervals are divided by the number of vblanks they span, so a vblank the
+ * process woke up too late for counts as missed but doesn't distort the jitter.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "drm_framebuffer.h"
+#include "vblank.h"
+
+#define VBLANK_BUCKETS 21
+
+struct vblank_stats {
+	/* Interval per vblank in seconds */
+	double *intervals;
+	size_t count;
+	size_t allocated;
+	uint64_t missed;
+	/* Time from the vblank to the return of the wait */
+	double wakeup_total;
+	double wakeup_max;
+};
+
+uint32_t vblank_crtc_select(uint32_t crtc_index)
+{
+	if (crtc_index == 0)
+		return 0;
+	if (crtc_index == 1)
+		return DRM_VBLANK_SECONDARY;
+
+	return (crtc_index << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Waits for the next vblank, returns its sequence number and timestamp */
+static int wait_vblank(struct framebuffer *fb, int precise, uint64_t *sequence, double *time)
+{
+	uint64_t ns;
+	drmVBlank vbl;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE | vblank_crtc_select(fb->crtc_index);
+	vbl.request.sequence = 1;
+	if (drmWaitVBlank(fb->fd, &vbl))
+		return -errno;
+
+	/* The ns timestamp belongs to the sequence number it came with, even if it is newer */
+	if (precise && !drmCrtcGetSequence(fb->fd, fb->crtc->crtc_id, sequence, &ns)) {
+		*time = ns / 1e9;
+		return 0;
+	}
+
+	*sequence = vbl.reply.sequence;
+	*time = vbl.reply.tval_sec + vbl.reply.tval_usec / 1e6;
+
+	return 1;
+}
+
+static int add_interval(struct vblank_stats *stats, double interval)
+{
+	if (stats->count == stats->allocated) {
+		size_t allocated = stats->allocated ? stats->allocated * 2 : 4096;
+		double *intervals = realloc(stats->intervals, allocated * sizeof(*intervals));
+
+		if (!intervals)
+			return -ENOMEM;
+		stats->intervals = intervals;
+		stats->allocated = allocated;
+	}
+	stats->intervals[stats->count++] = interval;
+
+	return 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(const struct vblank_stats *stats, double p)
+{
+	return stats->intervals[(size_t)(p / 100 * (stats->count - 1) + 0.5)];
+}
+
+/* 1, 2 or 5 times a power of ten, at least 0.1 us, so that the buckets have readable bounds */
+static double bucket_width(double range)
+{
+	double width = 1e-7;
+
+	while (width * (VBLANK_BUCKETS - 1) < range) {
+		if (width * 2 * (VBLANK_BUCKETS - 1) >= range)
+			return width * 2;
+		if (width * 5 * (VBLANK_BUCKETS - 1) >= range)
+			return width * 5;
+		width *= 10;
+	}
+
+	return width;
+}
+
+static void print_stats(struct vblank_stats *stats, double nominal)
+{
+	uint64_t buckets[VBLANK_BUCKETS];
+	uint64_t most = 0;
+	double sum = 0, squares = 0, mean, low, high, width, first;
+
+	if (stats->count < 2) {
+		printf("Not enough vblanks to measure\n");
+		return;
+	}
+
+	qsort(stats->intervals, stats->count, sizeof(*stats->intervals), compare_double);
+	for (size_t i = 0; i < stats->count; i++) {
+		sum += stats->intervals[i];
+		squares += stats->intervals[i] * stats->intervals[i];
+	}
+	mean = sum / stats->count;
+
+	printf("%zu intervals, %.3f Hz, %lu missed vblanks, wakeup %.1f us average, %.1f us max\n",
+	       stats->count, 1 / mean, (unsigned long)stats->missed,
+	       stats->wakeup_total * 1e6 / stats->count, stats->wakeup_max * 1e6);
+	printf("Interval: min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f us\n",
+	       stats->intervals[0] * 1e6, percentile(stats, 50) * 1e6, percentile(stats, 90) * 1e6,
+	       percentile(stats, 99) * 1e6, percentile(stats, 99.9) * 1e6,
+	       stats->intervals[stats->count - 1] * 1e6);
+	printf("Jitter: %.2f us standard deviation, %.1f us from %.1f us nominal on average\n",
+	       sqrt(fmax(squares / stats->count - mean * mean, 0)) * 1e6, (mean - nominal) * 1e6,
+	       nominal * 1e6);
+
+	/* Buckets around the nominal interval, everything beyond p0.1 and p99.9 goes to the ends */
+	low = percentile(stats, 0.1) - nominal;
+	high = percentile(stats, 99.9) - nominal;
+	width = bucket_width(fmax(fabs(low), fabs(high)) * 2);
+	first = -width * (VBLANK_BUCKETS / 2) - width / 2;
+
+	memset(buckets, 0, sizeof(buckets));
+	for (size_t i = 0; i < stats->count; i++) {
+		double bucket = floor((stats->intervals[i] - nominal - first) / width);
+
+		buckets[(size_t)fmin(fmax(bucket, 0), VBLANK_BUCKETS - 1)]++;
+	}
+	for (int i = 0; i < VBLANK_BUCKETS; i++) {
+		if (buckets[i] > most)
+			most = buckets[i];
+	}
+
+	printf("Deviation from the nominal interval:\n");
+	for (int i = 0; i < VBLANK_BUCKETS; i++) {
+		double from = (first + i * width) * 1e6;
+		int bar = (buckets[i] * 50 + most - 1) / most;
+		char label[48];
+
+		if (i == 0)
+			snprintf(label, sizeof(label), "< %+.1f", from + width * 1e6);
+		else if (i == VBLANK_BUCKETS - 1)
+			snprintf(label, sizeof(label), ">= %+.1f", from);
+		else
+			snprintf(label, sizeof(label), "%+.1f .. %+.1f", from, from + width * 1e6);
+		printf("  %22s us: %8lu %.*s\n", label, (unsigned long)buckets[i], bar,
+		       "##################################################");
+	}
+}
+
+int run_vblank(struct framebuffer *fb, uint32_t seconds)
+{
+	struct vblank_stats stats;
+	drmModeModeInfoPtr mode = fb->resolution;
+	double nominal, time, last_time, end;
+	uint64_t sequence, last_sequence;
+	int precise = 1;
+	int err;
+
+	memset(&stats, 0, sizeof(stats));
+
+	/* The vblank interval of the mode, vrefresh is rounded */
+	if (mode->clock && mode->htotal && mode->vtotal)
+		nominal = mode->htotal * (double)mode->vtotal / (mode->clock * 1000.0);
+	else
+		nominal = 1.0 / (mode->vrefresh ? mode->vrefresh : 60);
+	if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+		nominal /= 2;
+	if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+		nominal *= 2;
+
+	/* Vblanks only happen while the CRTC scans out */
+	err = show_framebuffer(fb);
+	if (err)
+		return err;
+
+	printf("Measuring vblanks of CRTC %u, %ux%u at %.3f Hz", fb->crtc->crtc_id, mode->hdisplay,
+	       mode->vdisplay, 1 / nominal);
+	if (seconds)
+		printf(" for %u s\n", seconds);
+	else
+		printf(" until interrupted\n");
+	fflush(stdout);
+
+	catch_termination();
+
+	err = wait_vblank(fb, precise, &last_sequence, &last_time);
+	if (err == 1) {
+		print_verbose("No drmCrtcGetSequence(), using us timestamps\n");
+		precise = 0;
+		err = 0;
+	}
+	end = now() + seconds;
+	while (!err && !terminate && (!seconds || now() < end)) {
+		double wakeup;
+
+		err = wait_vblank(fb, precise, &sequence, &time);
+		if (err < 0)
+			break;
+		err = 0;
+		wakeup = now() - time;
+
+		/* A vblank which ended up in the previous wait has nothing to compare */
+		if (sequence == last_sequence)
+			continue;
+
+		stats.missed += sequence - last_sequence - 1;
+		err = add_interval(&stats, (time - last_time) / (sequence - last_sequence));
+		if (wakeup > stats.wakeup_max)
+			stats.wakeup_max = wakeup;
+		stats.wakeup_total += wakeup;
+
+		last_sequence = sequence;
+		last_time = time;
+	}
+
+	/* SIGINT interrupts the last wait */
+	if (err == -EINTR && terminate)
+		err = 0;
+	if (err)
+		printf("Waiting for vblank failed (err=%d)\n", err);
+	else
+		print_stats(&stats, nominal);
+
+	free(stats.intervals);
+
+	return err;
+}
@@ -0,0 +1,32 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VBLANK_H
+#define VBLANK_H
+
+#include <stdint.h>
+
+#include "drm_framebuffer.h"
+
+/* drmWaitVBlank() selects the CRTC by its index in the request type */
+uint32_t vblank_crtc_select(uint32_t crtc_index);
+
+/*
+ * Measures the refresh interval of the CRTC for seconds, or until SIGTERM or SIGINT if seconds
+ * is 0, and prints a histogram of the deviation from the mode's interval with percentiles.
+ */
+int run_vblank(struct framebuffer *fb, uint32_t seconds);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Shows an image file and reloads it whenever it is rewritten. A watched directory shows the file
+ * which was written last. The mode is set once at startup, a reload only loads the image into
+ * the back buffer and flips, so there is no black flash in between. Images are decoded straight
+ * into the back buffer.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "drm_framebuffer.h"
+#include "buffer.h"
+#include "image.h"
+#include "watch.h"
+
+struct watch {
+	struct framebuffer *fb;
+	/* Directory which is watched, so files which are replaced by a rename are noticed too */
+	char dir[4096];
+	/* Only this file of the directory is shown, empty for all of them */
+	char name[256];
+	int inotify;
+	struct dumb_buffer scanout[2];
+	uint32_t back;
+	int flip_pending;
+	uint64_t reloads;
+};
+
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+			      unsigned int tv_usec, void *user_data)
+{
+	struct watch *watch = user_data;
+
+	watch->flip_pending = 0;
+}
+
+static int flip(struct watch *watch, struct dumb_buffer *buf)
+{
+	struct framebuffer *fb = watch->fb;
+	struct pollfd pfd = { .fd = fb->fd, .events = POLLIN };
+	drmEventContext ev = {
+		.version = 2,
+		.page_flip_handler = page_flip_handler,
+	};
+	int err;
+
+	err = master_acquire(fb);
+	if (err)
+		return err;
+	err = drmModePageFlip(fb->fd, fb->crtc->crtc_id, buf->fb_id, DRM_MODE_PAGE_FLIP_EVENT,
+			      watch);
+	master_release(fb);
+
+	if (err) {
+		printf("Page flip failed (err=%d)\n", err);
+		return err;
+	}
+
+	watch->flip_pending = 1;
+	while (watch->flip_pending) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		drmHandleEvent(fb->fd, &ev);
+	}
+
+	return 0;
+}
+
+static int reload(struct watch *watch, const char *name)
+{
+	struct dumb_buffer *buf = &watch->scanout[watch->back];
+	char path[4096 + 256];
+	int err;
+
+	snprintf(path, sizeof(path), "%s/%s", watch->dir, name);
+
+	/* A file which can't be loaded leaves the current image on the display */
+	if (load_image_to(watch->fb, path, buf->data, buf->pitch, IMAGE_CENTER))
+		return 0;
+
+	err = flip(watch, buf);
+	if (err)
+		return err;
+
+	watch->back ^= 1;
+	watch->reloads++;
+
+	return 0;
+}
+
+/* Reads all queued events, a burst of writes results in a single reload of the last file */
+static int handle_events(struct watch *watch)
+{
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char name[256] = "";
+	ssize_t len;
+
+	while ((len = read(watch->inotify, events, sizeof(events))) > 0) {
+		for (char *p = events; p < events + len;) {
+			const struct inotify_event *event = (const struct inotify_event *)p;
+
+			if (event->len && event->name[0] != '.' &&
+			    (!watch->name[0] || strcmp(event->name, watch->name) == 0))
+				snprintf(name, sizeof(name), "%s", event->name);
+
+			p += sizeof(*event) + event->len;
+		}
+	}
+
+	if (len < 0 && errno != EAGAIN && errno != EINTR)
+		return -errno;
+
+	return name[0] ? reload(watch, name) : 0;
+}
+
+int run_watch(struct framebuffer *fb, const char *path)
+{
+	struct watch watch;
+	struct stat st;
+	char copy[4096];
+	int err;
+
+	memset(&watch, 0, sizeof(watch));
+	watch.fb = fb;
+	watch.inotify = -1;
+
+	snprintf(copy, sizeof(copy), "%s", path);
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+		snprintf(watch.dir, sizeof(watch.dir), "%s", copy);
+	} else {
+		snprintf(watch.dir, sizeof(watch.dir), "%s", dirname(copy));
+		snprintf(copy, sizeof(copy), "%s", path);
+		snprintf(watch.name, sizeof(watch.name), "%s", basename(copy));
+	}
+
+	watch.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch.inotify < 0 ||
+	    inotify_add_watch(watch.inotify, watch.dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		printf("Could not watch %s\n", watch.dir);
+		err = -errno;
+		goto cleanup;
+	}
+
+	for (uint32_t i = 0; i < 2; i++) {
+		err = create_dumb_buffer(fb->fd, fb->res_x, fb->res_y, DRM_FORMAT_XRGB8888,
+					 &watch.scanout[i]);
+		if (err)
+			goto cleanup;
+	}
+
+	/* The file may not exist yet, the display stays black until it is written */
+	if (watch.name[0] && load_image_to(fb, path, watch.scanout[0].data, watch.scanout[0].pitch,
+					   IMAGE_CENTER))
+		memset(watch.scanout[0].data, 0, watch.scanout[0].size);
+
+	err = scanout_framebuffer(fb, watch.scanout[0].fb_id, 0, 0);
+	if (err)
+		goto cleanup;
+	watch.back = 1;
+
+	print_verbose("Watching %s/%s\n", watch.dir, watch.name[0] ? watch.name : "*");
+
+	catch_termination();
+
+	while (!terminate) {
+		struct pollfd pfd = { .fd = watch.inotify, .events = POLLIN };
+
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		err = handle_events(&watch);
+		if (err)
+			break;
+	}
+
+	print_verbose("Reloaded %lu times\n", (unsigned long)watch.reloads);
+
+	/* Don't pull the images away while one of them is scanned out */
+	scanout_framebuffer(fb, fb->buffer_id, fb->pan_x, fb->pan_y);
+
+cleanup:
+	for (uint32_t i = 0; i < 2; i++)
+		destroy_dumb_buffer(fb->fd, &watch.scanout[i]);
+	if (watch.inotify >= 0)
+		close(watch.inotify);
+
+	return err;
+}